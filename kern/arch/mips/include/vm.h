@@ -117,10 +117,8 @@ paddr_t ram_getfirstfree(void);
  */
 
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_vaddr;	/* page to invalidate */
+	pid_t ts_pid;		/* owner of the page, 0 for kernel (global) pages */
 };
 
 #define TLBSHOOTDOWN_MAX 16
@@ -41,6 +41,11 @@
 #include <syscall.h>
 
 #include <opt-paging.h>
+#if OPT_PAGING
+#include <kern/wait.h>
+#include <proc_syscalls.h>
+#include <oom.h>
+#endif
 
 /* in exception-*.S */
 extern __DEAD void asm_usermode(struct trapframe *tf);
@@ -113,7 +118,7 @@ kill_curthread(vaddr_t epc, unsigned code, vaddr_t vaddr)
 
 	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
 		code, sig, trapcodenames[code], epc, vaddr);
-	sys__exit(sig);
+	proc_exit(_MKWAIT_SIG(sig));
 #else	
 	kprintf("Fatal user mode trap %u sig %d (%s, epc 0x%x, vaddr 0x%x)\n",
 		code, sig, trapcodenames[code], epc, vaddr);
@@ -199,6 +204,21 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+#if OPT_PAGING
+		if (!iskern && oom_pending()) {
+			/*
+			 * The victim of the OOM killer sleeps on its way out:
+			 * the recorded state is interrupts on (spl 0), as in
+			 * user mode, but the processor still has them off.
+			 * Turn them on as the other traps do below, then die
+			 * at done like them.
+			 */
+			KASSERT(curthread->t_curspl == 0);
+			spl = splhigh();
+			splx(spl);
+			goto done;
+		}
+#endif
 		goto done2;
 	}
 
@@ -272,6 +292,12 @@ mips_trap(struct trapframe *tf)
 	 */
 
 	if (!iskern) {
+#if OPT_PAGING
+		/* the fault failed because the OOM killer chose this process */
+		if (oom_pending()) {
+			oom_exit();
+		}
+#endif
 		/*
 		 * Fatal fault in user mode.
 		 * Kill the current user process.
@@ -319,6 +345,12 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+#if OPT_PAGING
+	/* a process chosen by the OOM killer dies instead of going back to user mode */
+	if (!iskern && oom_pending()) {
+		oom_exit();
+	}
+#endif
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
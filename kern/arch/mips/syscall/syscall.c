@@ -34,6 +34,7 @@
 #include <mips/trapframe.h>
 #include <syscall.h>
 #include <thread.h>
+#include <copyinout.h>
 #include <types.h>
 
 /*
@@ -78,6 +79,8 @@ void syscall(struct trapframe *tf)
 {
 	int callno;
 	int32_t retval;
+	off_t retval64;		/* value of the calls returning 64 bits (lseek) */
+	bool is64;
 	int err;
 
 	KASSERT(curthread != NULL);
@@ -96,6 +99,7 @@ void syscall(struct trapframe *tf)
 	 */
 
 	retval = 0;
+	is64 = false;
 
 	switch (callno)
 	{
@@ -134,6 +138,51 @@ void syscall(struct trapframe *tf)
 		if (retval < 0)
 			err = -retval;
 		break;
+	case SYS_readv:
+		err = 0;
+		retval = sys_readv((int)tf->tf_a0, (userptr_t)tf->tf_a1, (int)tf->tf_a2);
+		if (retval < 0)
+			err = -retval;
+		break;
+	case SYS_writev:
+		err = 0;
+		retval = sys_writev((int)tf->tf_a0, (userptr_t)tf->tf_a1, (int)tf->tf_a2);
+		if (retval < 0)
+			err = -retval;
+		break;
+	case SYS_pread:
+	case SYS_pwrite:
+	{
+		/* a3 is skipped: the 64-bit position is on the user stack */
+		off_t pos;
+
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &pos, sizeof(pos));
+		if (err)
+			break;
+		if (callno == SYS_pread)
+			retval = sys_pread((int)tf->tf_a0, (void *)tf->tf_a1, (int)tf->tf_a2, pos);
+		else
+			retval = sys_pwrite((int)tf->tf_a0, (void *)tf->tf_a1, (int)tf->tf_a2, pos);
+		if (retval < 0)
+			err = -retval;
+		break;
+	}
+	case SYS_lseek:
+	{
+		/* the 64-bit position is in a2/a3, whence on the user stack */
+		int whence;
+
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &whence, sizeof(whence));
+		if (err)
+			break;
+		retval64 = sys_lseek((int)tf->tf_a0,
+				     ((off_t)tf->tf_a2 << 32) | tf->tf_a3, whence);
+		if (retval64 < 0)
+			err = -retval64;
+		else
+			is64 = true;
+		break;
+	}
 #endif
 #if OPT_PROC_SYSCALL
 	case SYS__exit:
@@ -144,9 +193,9 @@ void syscall(struct trapframe *tf)
 #if OPT_PROC_MANAGE
 	case SYS_waitpid:
 		err = 0;
-		retval = sys_waitpid((pid_t)tf->tf_a0, (int *)tf->tf_a1, (int)tf->tf_a2);
+		retval = sys_waitpid((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1, (int)tf->tf_a2);
 		if (retval < 0)
-			err = retval;
+			err = -retval;
 		break;
 	case SYS_getpid:
 		err = 0;
@@ -162,6 +211,59 @@ void syscall(struct trapframe *tf)
 		if (retval < 0)
 			err = -retval;
 		break;
+	case SYS_execv:
+		err = 0;
+		retval = sys_execv((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+		if (retval < 0)
+			err = -retval;
+		break;
+	case SYS_spawn:
+		err = 0;
+		retval = sys_spawn((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+		if (retval < 0)
+			err = -retval;
+		break;
+#endif
+#if OPT_PAGING
+	case SYS_sbrk:
+		err = 0;
+		retval = sys_sbrk((intptr_t)tf->tf_a0);
+		if (retval < 0)
+			err = -retval;
+		break;
+	case SYS_vmstat:
+		err = 0;
+		retval = sys_vmstat((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+				    (size_t)tf->tf_a2);
+		if (retval < 0)
+			err = -retval;
+		break;
+#if OPT_READ_WRITE
+	case SYS_mmap:
+	{
+		/* fd and the 64-bit offset are passed on the user stack */
+		int fd;
+		off_t offset;
+
+		err = copyin((const_userptr_t)(tf->tf_sp + 16), &fd, sizeof(fd));
+		if (err)
+			break;
+		err = copyin((const_userptr_t)(tf->tf_sp + 24), &offset, sizeof(offset));
+		if (err)
+			break;
+		retval = sys_mmap((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1, (int)tf->tf_a2,
+				  (int)tf->tf_a3, fd, offset);
+		if (retval < 0)
+			err = -retval;
+		break;
+	}
+	case SYS_munmap:
+		err = 0;
+		retval = sys_munmap((vaddr_t)tf->tf_a0, (size_t)tf->tf_a1);
+		if (retval < 0)
+			err = -retval;
+		break;
+#endif
 #endif
 	default:
 		kprintf("Unknown syscall %d\n", callno);
@@ -182,7 +284,14 @@ void syscall(struct trapframe *tf)
 	else
 	{
 		/* Success. */
-		tf->tf_v0 = retval;
+		if (is64) {
+			/* high word in v0, low word in v1 */
+			tf->tf_v0 = (uint32_t)(retval64 >> 32);
+			tf->tf_v1 = (uint32_t)retval64;
+		}
+		else {
+			tf->tf_v0 = retval;
+		}
 		tf->tf_a3 = 0; /* signal no error */
 	}
 
@@ -55,6 +55,7 @@
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -109,6 +110,85 @@ flush_delay_buf(void)
 
 //////////////////////////////////////////////////
 
+/*
+ * Output through the ring buffer. Characters are queued and the
+ * write-done interrupt (con_start) sends the next one, so a writer
+ * only waits when the ring is full, not for every character. Only
+ * the first character of a burst is sent from here, to get the
+ * interrupts going.
+ *
+ * Must be called with cs_outlock held.
+ */
+static
+void
+con_kick(struct con_softc *cs)
+{
+	unsigned char ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_outlock));
+
+	if (cs->cs_busy || cs->cs_putchars_head == cs->cs_putchars_tail) {
+		return;
+	}
+	ch = cs->cs_putchars[cs->cs_putchars_tail];
+	cs->cs_putchars_tail =
+		(cs->cs_putchars_tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	cs->cs_busy = true;
+	cs->cs_send(cs->cs_devdata, ch);
+}
+
+/*
+ * Queue characters, using interrupts to wait for I/O completion
+ * when the ring is full.
+ */
+static
+void
+putchars_intr(struct con_softc *cs, const char *buf, size_t len)
+{
+	unsigned nexthead;
+	size_t i;
+
+	spinlock_acquire(&cs->cs_outlock);
+	for (i=0; i<len; i++) {
+		nexthead = (cs->cs_putchars_head + 1) %
+			CONSOLE_OUTPUT_BUFFER_SIZE;
+		while (nexthead == cs->cs_putchars_tail) {
+			con_kick(cs);
+			wchan_sleep(cs->cs_outwchan, &cs->cs_outlock);
+		}
+		cs->cs_putchars[cs->cs_putchars_head] = buf[i];
+		cs->cs_putchars_head = nexthead;
+	}
+	con_kick(cs);
+	spinlock_release(&cs->cs_outlock);
+}
+
+/*
+ * Send by polling whatever is still queued in the ring, so that
+ * output printed by polling (from interrupt handlers, and above all
+ * by panic) comes out after everything written before it.
+ */
+static
+void
+flush_polled(struct con_softc *cs)
+{
+	unsigned char ch;
+
+	if (spinlock_do_i_hold(&cs->cs_outlock)) {
+		/* panic from inside the console itself; just print */
+		return;
+	}
+	spinlock_acquire(&cs->cs_outlock);
+	while (cs->cs_putchars_head != cs->cs_putchars_tail) {
+		ch = cs->cs_putchars[cs->cs_putchars_tail];
+		cs->cs_putchars_tail =
+			(cs->cs_putchars_tail + 1) % CONSOLE_OUTPUT_BUFFER_SIZE;
+		cs->cs_sendpolled(cs->cs_devdata, ch);
+	}
+	wchan_wakeall(cs->cs_outwchan, &cs->cs_outlock);
+	spinlock_release(&cs->cs_outlock);
+}
+
 /*
  * Print a character, using polling instead of interrupts to wait for
  * I/O completion.
@@ -117,20 +197,26 @@ static
 void
 putch_polled(struct con_softc *cs, int ch)
 {
+	flush_polled(cs);
 	cs->cs_sendpolled(cs->cs_devdata, ch);
 }
 
 //////////////////////////////////////////////////
 
 /*
- * Print a character, using interrupts to wait for I/O completion.
+ * Take the next character out of the input buffer. The caller has
+ * already done P on cs_rsem for it.
  */
 static
-void
-putch_intr(struct con_softc *cs, int ch)
+int
+con_take(struct con_softc *cs)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	unsigned char ret;
+
+	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
+	cs->cs_gotchars_tail =
+		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	return ret;
 }
 
 /*
@@ -140,13 +226,40 @@ static
 int
 getch_intr(struct con_softc *cs)
 {
-	unsigned char ret;
+	P(cs->cs_rsem);
+	return con_take(cs);
+}
+
+/*
+ * Read a line, or as much of it as has been typed: wait for the first
+ * character, then take the ones already in the input buffer, stopping
+ * after a newline. Carriage returns are turned into newlines; ^C ends
+ * the input and is not returned, so at the start of a line it reads
+ * as end of file.
+ */
+static
+size_t
+getchars_intr(struct con_softc *cs, char *buf, size_t len)
+{
+	size_t n = 0;
+	int ch;
 
 	P(cs->cs_rsem);
-	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
-	cs->cs_gotchars_tail =
-		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
-	return ret;
+	ch = con_take(cs);
+	while (1) {
+		if (ch == '\r') {
+			ch = '\n';
+		}
+		if (ch == CONSOLE_INTR_CHAR) {
+			break;
+		}
+		buf[n++] = ch;
+		if (ch == '\n' || n == len || !sem_tryP(cs->cs_rsem)) {
+			break;
+		}
+		ch = con_take(cs);
+	}
+	return n;
 }
 
 /*
@@ -178,13 +291,19 @@ con_input(void *vcs, int ch)
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ * Send the next queued character, if any, and wake up the writers
+ * waiting for room.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_outlock);
+	cs->cs_busy = false;
+	con_kick(cs);
+	wchan_wakeall(cs->cs_outwchan, &cs->cs_outlock);
+	spinlock_release(&cs->cs_outlock);
 }
 
 //////////////////////////////////////////////////
@@ -211,7 +330,32 @@ putch(int ch)
 		putch_polled(cs, ch);
 	}
 	else {
-		putch_intr(cs, ch);
+		char c = ch;
+		putchars_intr(cs, &c, 1);
+	}
+}
+
+/*
+ * Print a buffer of characters. From thread context this queues the
+ * whole buffer with a single acquisition of the output lock and
+ * returns as soon as it is in the ring.
+ */
+void
+putchars(const char *buf, size_t len)
+{
+	struct con_softc *cs = the_console;
+	size_t i;
+
+	if (cs==NULL ||
+	    curthread->t_in_interrupt ||
+	    curthread->t_curspl > 0 ||
+	    curcpu->c_spinlocks > 0) {
+		for (i=0; i<len; i++) {
+			putch(buf[i]);
+		}
+	}
+	else {
+		putchars_intr(cs, buf, len);
 	}
 }
 
@@ -225,6 +369,29 @@ getch(void)
 	return getch_intr(cs);
 }
 
+/*
+ * Read up to len characters, returning at the end of a line or when
+ * no more input is available (see getchars_intr). Readers are
+ * serialized, so a line is never split between two of them.
+ */
+size_t
+getchars(char *buf, size_t len)
+{
+	struct con_softc *cs = the_console;
+	size_t n;
+
+	KASSERT(cs != NULL);
+	KASSERT(!curthread->t_in_interrupt && curthread->t_iplhigh_count == 0);
+
+	if (len == 0) {
+		return 0;
+	}
+	lock_acquire(con_userlock_read);
+	n = getchars_intr(cs, buf, len);
+	lock_release(con_userlock_read);
+	return n;
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -246,48 +413,33 @@ con_io(struct device *dev, struct uio *uio)
 {
 	int result;
 	char ch;
-	struct lock *lk;
+	char buf[CONSOLE_INPUT_BUFFER_SIZE];
+	size_t len;
 
 	(void)dev;  // unused
 
 	if (uio->uio_rw==UIO_READ) {
-		lk = con_userlock_read;
-	}
-	else {
-		lk = con_userlock_write;
+		/* one line, or what has been typed so far */
+		len = uio->uio_resid < sizeof(buf) ? uio->uio_resid : sizeof(buf);
+		len = getchars(buf, len);
+		return uiomove(buf, len, uio);
 	}
 
-	KASSERT(lk != NULL);
-	lock_acquire(lk);
+	KASSERT(con_userlock_write != NULL);
+	lock_acquire(con_userlock_write);
 
 	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				break;
-			}
+		result = uiomove(&ch, 1, uio);
+		if (result) {
+			lock_release(con_userlock_write);
+			return result;
 		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
+		if (ch=='\n') {
+			putch('\r');
 		}
+		putch(ch);
 	}
-	lock_release(lk);
+	lock_release(con_userlock_write);
 	return 0;
 }
 
@@ -343,7 +495,8 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct semaphore *rsem;
+	struct wchan *wchan;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -363,29 +516,33 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
+	wchan = wchan_create("console write");
+	if (wchan == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(wchan);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
 		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(wchan);
 		return ENOMEM;
 	}
 
 	cs->cs_rsem = rsem;
-	cs->cs_wsem = wsem;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	spinlock_init(&cs->cs_outlock);
+	cs->cs_outwchan = wchan;
+	cs->cs_putchars_head = 0;
+	cs->cs_putchars_tail = 0;
+	cs->cs_busy = false;
 
 	the_console = cs;
 	con_userlock_read = rlk;
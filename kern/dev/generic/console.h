@@ -30,6 +30,8 @@
 #ifndef _GENERIC_CONSOLE_H_
 #define _GENERIC_CONSOLE_H_
 
+#include <spinlock.h>
+
 /*
  * Device data for the hardware-independent system console.
  *
@@ -37,7 +39,9 @@
  * device, and are to be initialized by the attach routine.
  */
 
-#define CONSOLE_INPUT_BUFFER_SIZE 32
+#define CONSOLE_INPUT_BUFFER_SIZE 256
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
+#define CONSOLE_INTR_CHAR 3		/* ^C: ends the input of a read */
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -47,10 +51,17 @@ struct con_softc {
 
 	/* initialized by config routine */
 	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+
+	/* output ring, drained by the write-done interrupt */
+	struct spinlock cs_outlock;	/* protects the fields below */
+	struct wchan *cs_outwchan;	/* writers waiting for room */
+	unsigned char cs_putchars[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_putchars_head;	/* next slot to put a char in */
+	unsigned cs_putchars_tail;	/* next slot to take a char out */
+	bool cs_busy;			/* a char is on its way to the device */
 };
 
 /*
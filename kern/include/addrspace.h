@@ -40,6 +40,7 @@
 #include "opt-paging.h"
 
 struct vnode;
+struct segment;
 
 
 /*
@@ -52,17 +53,10 @@ struct vnode;
 struct addrspace {
 
 #if OPT_PAGING        
-        vaddr_t as_vbase1;
-        paddr_t as_elfbase1;
-        size_t as_npages1;
-        off_t as_offset1;
-        size_t as_filesize1;
-        vaddr_t as_vbase2;
-        paddr_t as_elfbase2;
-        size_t as_npages2;
-        off_t as_offset2;
-        size_t as_filesize2;
-        uint8_t as_flags;             /* contains the RWX flags for each of the 2 segments (- - R2 W2 X2 R1 W1 X1)*/
+        struct segment *as_segs;      /* regions of the address space, sorted by base address (see segments.h) */
+        unsigned as_nsegs;            /* number of regions */
+        unsigned as_maxsegs;          /* allocated size of as_segs */
+        vaddr_t as_heapbrk;           /* current break (end of the heap, not page aligned) */
 #elif OPT_DUMBVM
         vaddr_t as_vbase1;
         paddr_t as_pbase1;
@@ -132,7 +126,10 @@ int               as_define_region(struct addrspace *as,
                                    off_t offset,
                                    size_t filesize);
 
-int load_page(vaddr_t vaddr, int is_executable);
+/* fill the frame with the page at vaddr of seg; *fromfile is set if file data was read */
+int fill_page(struct segment *seg, vaddr_t vaddr, paddr_t paddr, int *fromfile);
+/* fill_page for a page fault (updates the fault statistics) */
+int load_page(struct segment *seg, vaddr_t vaddr, paddr_t paddr);
 #else
 int               as_define_region(struct addrspace *as,
                                    vaddr_t vaddr, size_t sz,
@@ -15,6 +15,7 @@
 #include <cpu.h>
 #include <thread.h>
 #include <pt.h>
+#include <vmalloc.h>
 #include <current.h>
 #include "opt-paging.h"
 #include <opt-vm_manage.h>
@@ -22,5 +23,8 @@
 paddr_t getFreePages(unsigned int n);
 void free_ppage(paddr_t paddr);
 void pageSetUsed(unsigned int i);
+/* free the pages allocated at page; returns the number of clusters that give_back_mem would hand back to the page table */
 int return_mem(uint32_t page);
+/* take the free clusters at the end of kernel memory away from the kernel; returns their number */
+int give_back_mem(void);
 #endif /* _COREMAP_H_ */
\ No newline at end of file
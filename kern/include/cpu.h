@@ -36,6 +36,12 @@
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/*
+ * Number of free kernel stacks each cpu keeps for reuse by
+ * thread_fork, instead of returning them to kfree.
+ */
+#define CPU_STACKPOOL_SIZE 8
+
 /*
  * Per-cpu structure
  *
@@ -61,6 +67,8 @@ struct cpu {
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	void *c_stackpool[CPU_STACKPOOL_SIZE]; /* Free kernel stacks */
+	unsigned c_nstackpool;		/* Number of stacks in c_stackpool */
 
 	/*
 	 * Accessed by other cpus.
@@ -82,10 +90,18 @@ struct cpu {
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
 	 * and vaddr pair, or a paddr, or something else.
+	 *
+	 * When the queue overflows, c_shootdown_all is set instead and
+	 * the whole TLB is flushed. c_shootdown_seq counts the requests
+	 * queued so far and c_shootdown_done the ones completed, so
+	 * that a sender can wait for its own.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	bool c_shootdown_all;
+	unsigned c_shootdown_seq;
+	volatile unsigned c_shootdown_done;
 	struct spinlock c_ipi_lock;
 
 	/*
@@ -155,6 +171,10 @@ void cpu_halt(void);
  * ipi_send sends an IPI to one CPU.
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
+ * ipi_tlbshootdown_batch queues several shootdowns with one IPI (NULL
+ * mappings means flush the whole TLB) and returns a ticket;
+ * ipi_tlbshootdown_wait waits until the target has carried out the
+ * requests up to that ticket.
  *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
@@ -169,6 +189,9 @@ void cpu_halt(void);
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
+unsigned ipi_tlbshootdown_batch(struct cpu *target,
+				const struct tlbshootdown *mappings, unsigned n);
+void ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket);
 
 void interprocessor_interrupt(void);
 
@@ -0,0 +1,18 @@
+#ifndef _KERN_MMAN_H_
+#define _KERN_MMAN_H_
+
+/*
+ * Constants for mmap.
+ */
+
+/* Protection of the mapped pages */
+#define PROT_NONE      0     /* Pages cannot be accessed */
+#define PROT_READ      1     /* Pages can be read */
+#define PROT_WRITE     2     /* Pages can be written */
+#define PROT_EXEC      4     /* Pages can be executed */
+
+/* Type of mapping (exactly one of them) */
+#define MAP_SHARED     1     /* Share the file pages (read-only mappings only) */
+#define MAP_PRIVATE    2     /* Writes stay private to the process */
+
+#endif /* _KERN_MMAN_H_ */
@@ -0,0 +1,29 @@
+#ifndef _KERN_VMSTATS_H_
+#define _KERN_VMSTATS_H_
+
+/*
+ * Indexes of the VM counters returned by vmstat(). The same counters
+ * are kept for the whole system and for each process.
+ */
+
+#define VMS_FAULTS          0 /* The number of TLB misses that have occurred (not including faults that cause a program to crash) */ 
+#define VMS_FAULTS_FREE     1 /* The number of TLB misses for which there was free space in the TLB to add the new TLB entry (i.e., no replacement is required)*/
+#define VMS_FAULTS_REPLACE  2 /* The number of TLB misses for which there was no free space for the new TLB entry, so replacement was required*/
+#define VMS_INVALIDATE      3 /* The number of times the TLB was invalidated (this counts the number times the entire TLB is invalidated NOT the number of TLB entries invalidated)*/
+#define VMS_RELOAD          4 /* The number of TLB misses for pages that were already in memory*/
+#define VMS_FAULTS_ZEROED   5 /* The number of TLB misses that required a new page to be zerofilled. */
+#define VMS_FAULTS_DISK     6 /* The number of TLB misses that required a page to be loaded from disk. */
+#define VMS_FAULTS_ELF      7 /* The number of page faults that require getting a page from the ELF file. */
+#define VMS_FAULTS_SWAPFILE 8 /* The number of page faults that require getting a page from the swap file. */  
+#define VMS_SWAPFILE_WRITES 9 /* The number of page faults that require writing a page to the swap file. */
+#define VMS_ZEROPAGE_MAPS  10 /* The number of zero-fill faults served by mapping the shared zero page (included in VMS_FAULTS_ZEROED) */
+#define VMS_FAULTS_MMAP    11 /* The number of page faults that require getting a page from a mapped file. */
+#define VMS_READAHEAD      12 /* The number of pages of mapped files loaded ahead of a fault (not faults themselves) */
+#define VMS_SHOOTDOWNS     13 /* The number of TLB shootdown requests sent to other CPUs */
+#define VMS_EVICTIONS      14 /* The number of pages evicted from memory to make room for another one */
+#define VMS_OOMKILLS       15 /* The number of processes killed because memory and swap space were exhausted */
+
+/* number of counters */
+#define VMS_NSTATS         16
+
+#endif /* _KERN_VMSTATS_H_ */
@@ -162,7 +162,9 @@ const char *strerror(int errcode);
  * Low-level console access.
  */
 void putch(int ch);
+void putchars(const char *buf, size_t len);
 int getch(void);
+size_t getchars(char *buf, size_t len);
 void beep(void);
 
 /*
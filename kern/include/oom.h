@@ -0,0 +1,25 @@
+#ifndef _OOM_H_
+#define _OOM_H_
+
+#include <types.h>
+#include <lib.h>
+
+/* times a fault retries after the OOM killer released the pages of a victim before failing */
+#define OOM_RETRIES 64
+
+/*
+ * Called when a page cannot be evicted because the swapfile is full:
+ * marks the process with the most pages in memory and in the swapfile
+ * to be killed and releases its pages (unless another thread is
+ * already doing it). Returns ENOMEM if the current process was chosen
+ * or there is nobody to kill, 0 if the caller can retry.
+ */
+int oom_kill(void);
+
+/* true if the current process was chosen by the OOM killer */
+bool oom_pending(void);
+
+/* kill the current process (chosen by the OOM killer), releasing its memory right away */
+void oom_exit(void);
+
+#endif /* _OOM_H_ */
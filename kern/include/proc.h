@@ -44,6 +44,7 @@
 #include <types.h>
 
 struct addrspace;
+struct proc_status;
 struct thread;
 struct vnode;
 #if OPT_READ_WRITE
@@ -52,6 +53,7 @@ struct vnode;
 #include <limits.h>
 #include <kern/errno.h>
 #include <kern/unistd.h>
+#include <kern/vmstats.h>
 /*
  * Process structure.
  *
@@ -81,18 +83,21 @@ struct proc {
 	struct vnode *p_cwd;		/* current working directory */
 
   /* add more material here as needed */
-  int exit_status;   /* the exit status of the current process */
+  int exit_status;   /* the wait status (_MKWAIT_*) of the current process */
 #if OPT_PROC_MANAGE
-  struct semaphore* ended_sem;
   pid_t pid;
-  struct proc* parent;
+  struct proc_status* p_status;	/* exit status, outlives the process until it is reaped */
+  struct proc_status* p_children;	/* exit status of the children (under p_lock) */
 #endif
 #if OPT_READ_WRITE
   struct openfile* open_files[OPEN_MAX];
+  uint32_t p_fdused[(OPEN_MAX + 31) / 32];	/* descriptors in use (a bit each), to find the lowest free one */
 #endif
 
 #if OPT_PAGING
 	struct vnode* p_elf;
+	unsigned int p_vmstats[VMS_NSTATS];	/* VM events of this process (written by its thread only) */
+	volatile bool p_oomkilled;		/* chosen by the OOM killer, exits on its way back to user mode */
 #endif
 };
 
@@ -121,18 +126,41 @@ struct addrspace *proc_getas(void);
 struct addrspace *proc_setas(struct addrspace *);
 
 #if OPT_PROC_MANAGE
-/* waits for process termination*/
-int proc_wait(struct proc* p);
+/* waits for the termination of child pid of the current process and reaps it; returns its wait status */
+int proc_wait(pid_t pid);
 
-/* get process strcuture by pid */
-struct proc* get_proc_by_pid(pid_t pid);
+/* wait for (unless WNOHANG) and reap child pid of the current process; returns pid, 0 if still running, -ECHILD */
+pid_t proc_wait_child(pid_t pid, int options, int* status);
+
+/* make child a child of parent */
+void proc_add_child(struct proc* parent, struct proc* child);
+
+/* pid of the parent of p, 0 if it has gone */
+pid_t proc_getppid(struct proc* p);
 
 /* duplicate a process */
 struct proc* proc_dup(struct proc* old);
+
+/* child of old named name, with the cwd and descriptors of old but no address space yet */
+struct proc* proc_spawn(struct proc* old, const char* name);
+
+/* give p the name name (a kmalloc'd string, which p takes over) */
+void proc_rename(struct proc* p, char* name);
+#if OPT_PAGING
+int proc_vmstats(pid_t pid, unsigned int *counts, char *name, size_t namelen);
+
+/* true if process pid was marked by the OOM killer and still has its address space */
+bool proc_oom_pending(pid_t pid);
+
+/* mark the user process with the most pages (pages[pid]) for the OOM killer; returns its pid, -1 if none */
+pid_t proc_oom_mark(const unsigned int *pages);
+#endif
 #endif
 
 #if OPT_READ_WRITE
+/* install file at the lowest free descriptor of the current process; returns it, -EMFILE if none */
 int proc_add_file(struct openfile* file);
+/* remove descriptor fd of the current process; returns its open file, NULL if it was not open */
 struct openfile* proc_rem_file(int fd);
 #endif
 #endif /* _PROC_H_ */
@@ -14,12 +14,18 @@
 
 #if OPT_PROC_SYSCALL
 void sys__exit(int status);
+/* terminate the current process with wait status status (_MKWAIT_*) */
+void proc_exit(int status);
 #endif
 
 #if OPT_PROC_MANAGE
-pid_t sys_waitpid(pid_t pid, int* status, int options);
+pid_t sys_waitpid(pid_t pid, userptr_t status, int options);
 pid_t sys_getpid(void);
 pid_t sys_getppid(void);
 pid_t sys_fork(struct trapframe* tf);
+/* replace the image of the current process; returns only on error (-errno) */
+int sys_execv(userptr_t upath, userptr_t uargv);
+/* start a child running the program upath, without copying the caller; returns its pid (-errno) */
+pid_t sys_spawn(userptr_t upath, userptr_t uargv);
 #endif
 #endif
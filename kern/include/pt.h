@@ -1,9 +1,6 @@
 #ifndef _PT_H
 #define _PT_H
 
-#define STACKPAGES  18
-
-
 // Errors
 #define ERR_CODE ((paddr_t) -1)
 
@@ -19,39 +16,89 @@
 #include <current.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
+#include <segments.h>
 #include <vm.h>
 #include <coremap.h>
 #include <proc_syscalls.h>
 #include <vm_tlb.h>
 #include <vmstats.h>
 #include <swapfile.h>
+#include <membar.h>
+#include <vmtrace.h>
+#include <oom.h>
+
+/* entries per cluster (associativity of the page table): 2, 4, 8 or 16, chosen at boot with ptconf */
+extern int pt_cluster_size;
+#define CLUSTER_SIZE pt_cluster_size
+#define PT_MAX_CLUSTER_SIZE 16
+
+/* hash functions of the page table, chosen at boot with ptconf */
+#define PT_HASH_MOD  0      /* (vpn * pid) % clusters */
+#define PT_HASH_MULT 1      /* multiplicative (golden ratio) hash of pid << 20 | vpn */
+#define PT_HASH_XOR  2      /* xorshift32 of pid << 20 | vpn */
+/* pages of a mapped file loaded after the one that faulted */
+#define PT_READAHEAD 4
 
-#define CLUSTER_SIZE 4
+/*
+ * An entry is page | pid << 1 | dirty. PT_BUSY_BIT (above the largest
+ * pid) is set while the frame is being filled: the slot is never chosen
+ * as a victim and the page is not mapped in any TLB until it is cleared.
+ */
+#define PT_BUSY_BIT 0x800
 
 /* macros for accessing the PT entry fields */
 #define PT_V_ADDR(entry) ((unsigned int)((entry) & PAGE_FRAME))
-#define PT_PID(entry)    ((int)(((entry) & (~PAGE_FRAME)) >> 1))
+#define PT_PID(entry)    ((int)(((entry) & ~PAGE_FRAME & ~PT_BUSY_BIT) >> 1))
 #define PT_P_ADDR(entry) ((entry) * PAGE_SIZE)
 #define PT_DIRTY(entry)  ((entry) & 1 )
+#define PT_BUSY(entry)   ((entry) & PT_BUSY_BIT)
 
 typedef int pt_entry;
 
+/* apply the "ptconf <assoc> <hash>" command of the boot arguments (called before vm_bootstrap) */
+void pt_boot_options(const char *args);
+
+/* returns 0 if "ptconf" with these arguments matches the configuration chosen at boot */
+int pt_check_config(int nargs, char **args);
+
+/* print the page table configuration */
+void pt_print_config(void);
+
 /* bootstrap for the page table */
 void pt_bootstrap(int first_free);
 
-/* returns the entry corresponding to the page associated to the address v_addr (if that page is not in memory it will be loaded)*/
-int pt_get_page(vaddr_t v_addr);
+/* allocate the shared zero frame (called before the coremap is active) */
+void pt_zero_bootstrap(void);
+
+/* returns the entry corresponding to the page associated to the address v_addr (if that page is not in memory it will be loaded)
+   and in *path how the fault was served (VMT_*) */
+int pt_get_page(vaddr_t v_addr, int faulttype, int *path);
+
+/* delete the pages in [start, end) of process pid from page table and swapfile */
+void pt_delete_range(vaddr_t start, vaddr_t end, pid_t pid);
 
 /* delete all pages of this process from page table */
 void pt_delete_PID(struct addrspace *as, pid_t pid);
 
+/* release the pages of process pid (chosen by the OOM killer) at once; returns their number */
+unsigned int pt_reap(pid_t pid);
+
 /* allocate clusters for kernel pages*/
 paddr_t pt_getkpages(uint32_t n_pages);
 
+/* allocate n_pages contiguous frames only if they are already free, never taking clusters from the page table */
+paddr_t pt_getfreekpages(uint32_t n_pages);
+
 /* free allocated kernel clusters */
 void pt_freekpages(uint32_t n_clusters);
 
 /* stats for used and unused pages */
 int pt_stats(void);
 
+/* add to counts[pid] the frames held by each process (counts has PID_MAX entries) */
+void pt_usage(unsigned int *counts);
+
+/* report on the occupancy and the conflicts of the clustered hash (key=value lines if dump is set) */
+void pt_report(int dump);
+
 #endif
\ No newline at end of file
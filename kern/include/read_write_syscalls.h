@@ -15,13 +15,33 @@
 #include <uio.h>
 #include <copyinout.h>
 
-#define SYS_OPEN_FILE_MAX 10*OPEN_MAX
+/* largest transfer done by a single VOP_READ/VOP_WRITE of a read or write call */
+#define IO_CHUNK (64*1024)
+/* largest piece of a console read or write copied in or out at once */
+#define CON_CHUNK 4096
+/* largest total length of readv/writev (the count returned is an int) */
+#define IOV_LEN_MAX 0x7fffffff
 
 #if OPT_READ_WRITE
+struct openfile;
+
 int sys_read(int file, void* buffer, int size);
 int sys_write(int file, void* buffer, int size);
 int sys_open(char* filename, int flags);
 int sys_close(int fd);
+/* read/write at pos, without using or moving the offset of the file */
+int sys_pread(int file, void* buffer, int size, off_t pos);
+int sys_pwrite(int file, void* buffer, int size, off_t pos);
+/* scatter/gather read/write of iovcnt (at most IOV_MAX) user iovecs, with a single file system call */
+int sys_readv(int file, userptr_t iov, int iovcnt);
+int sys_writev(int file, userptr_t iov, int iovcnt);
+/* returns the new offset of the file, -errno on error */
+off_t sys_lseek(int file, off_t pos, int whence);
+/* add/drop a reference to an open file (the last one closes its vnode) */
+void openfile_incref(struct openfile* of);
+void openfile_release(struct openfile* of);
+/* returns the vnode of fd and its open mode (in *mode), NULL if fd is not open */
+struct vnode *file_get_vnode(int fd, int *mode);
 #endif
 
 #endif
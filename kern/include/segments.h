@@ -0,0 +1,85 @@
+#ifndef _SEGMENTS_H_
+#define _SEGMENTS_H_
+
+#include <types.h>
+#include <lib.h>
+#include <vm.h>
+
+struct addrspace;
+struct vnode;
+
+/* permissions of a segment (same values as the ELF PF_* flags) */
+#define SEG_X 0x1
+#define SEG_W 0x2
+#define SEG_R 0x4
+/* kind of region (also kept in s_flags) */
+#define SEG_STACK 0x8           /* grows down on faults below its base */
+#define SEG_HEAP  0x10          /* resized by sbrk */
+
+/* stack rlimit: the stack can grow down to USERSTACK - SEG_STACK_MAXPAGES pages */
+#define SEG_STACK_MAXPAGES 1024
+/* the stack starts with a single page, the rest is added on demand */
+#define SEG_STACK_INITPAGES 1
+/* lowest address the stack can ever reach; the heap stops a guard page below it */
+#define SEG_STACK_LIMIT (USERSTACK - SEG_STACK_MAXPAGES * PAGE_SIZE)
+
+/* where the content of a page comes from the first time it is touched */
+#define SEG_BACKING_ZERO 0      /* zero-filled (stack) */
+#define SEG_BACKING_ELF  1      /* loaded from the program ELF file, zero-filled past s_filesize */
+#define SEG_BACKING_FILE 2      /* mmap of s_vnode, zero-filled past s_filesize */
+
+/*
+ * A region of the address space. The region spans whole pages
+ * starting from s_vbase; the data in the ELF file (if any) starts at
+ * the possibly unaligned address s_elfbase and is s_filesize bytes long.
+ */
+struct segment {
+	vaddr_t s_vbase;        /* first page of the region */
+	size_t s_npages;        /* length of the region in pages */
+	vaddr_t s_elfbase;      /* address of the first byte of file data */
+	off_t s_offset;         /* offset in the file of s_elfbase */
+	size_t s_filesize;      /* bytes of file data */
+	uint8_t s_flags;        /* SEG_R | SEG_W | SEG_X, SEG_STACK | SEG_HEAP */
+	uint8_t s_backing;      /* SEG_BACKING_* */
+	struct vnode *s_vnode;  /* mapped file (SEG_BACKING_FILE only, holds a reference) */
+	vaddr_t s_touchlo;      /* pages that ever got a frame are all in [s_touchlo, s_touchhi) */
+	vaddr_t s_touchhi;
+};
+
+/* first address past the end of the region */
+#define SEG_END(seg) ((seg)->s_vbase + (seg)->s_npages * PAGE_SIZE)
+
+/* init the (empty) segment list of an address space */
+void seg_init(struct addrspace *as);
+
+/* free the segment list of an address space */
+void seg_destroy(struct addrspace *as);
+
+/* insert a region keeping the list sorted; fails with EINVAL if it overlaps another one */
+int seg_add(struct addrspace *as, const struct segment *seg);
+
+/* returns the region containing vaddr (binary search), NULL if there is none */
+struct segment *seg_find(struct addrspace *as, vaddr_t vaddr);
+
+/* copy the segment list of old into new (which must be empty) */
+int seg_copy(struct addrspace *old, struct addrspace *new);
+
+/* record that the page at vaddr got a frame (so it is freed at teardown) */
+void seg_touch(struct segment *seg, vaddr_t vaddr);
+
+/* grow the stack down to include vaddr; returns the stack region, NULL if vaddr is past the limit */
+struct segment *seg_grow_stack(struct addrspace *as, vaddr_t vaddr);
+
+/* returns the heap region, NULL if the address space has none */
+struct segment *seg_heap(struct addrspace *as);
+
+/* returns the base of a free range of npages for a new mapping, 0 if there is none */
+vaddr_t seg_find_free(struct addrspace *as, size_t npages);
+
+/* split the region at index idx in two at the page-aligned address at */
+int seg_split(struct addrspace *as, unsigned idx, vaddr_t at);
+
+/* remove the region at index idx (its pages must already be released) */
+void seg_remove(struct addrspace *as, unsigned idx);
+
+#endif /* _SEGMENTS_H_ */
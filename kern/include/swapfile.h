@@ -13,6 +13,7 @@
 
 #define SWAP_DISCARD    0
 #define SWAP_LOAD       1
+#define SWAP_LOOKUP     2
 
 #define SWAP_FILESIZE   9*1024*1024
 
@@ -25,15 +26,18 @@ void swap_bootstrap(void);
 /*  swap_in
     vaddr_t v_addr: indirizzo logico della pagina
                     da caricare in memoria
+    paddr_t p_addr: indirizzo fisico del frame in cui
+                    caricarla (usato solo con SWAP_LOAD)
     pid_t      pid: pid del processo
     uint8_t  store: SWAP_DISCARD per scartarla, SWAP_LOAD per
-                    copiarla in memoria
-    Prende la pagina dallo swapfile e la carica in memoria,
-    se non trova la pagina non fa nulla.
+                    copiarla in memoria, SWAP_LOOKUP per verificare
+                    soltanto se e' presente (lo SWAPFILE non cambia)
+    Prende la pagina dallo swapfile e la carica nel frame
+    p_addr (attraverso kseg0), se non trova la pagina non fa nulla.
     Ritorna 0 se NON trova la pagina nello SWAPFILE, altrimenti
     ritorna un valore diverso da 0.
 */
-int swap_in(vaddr_t v_addr, pid_t pid, uint8_t store);
+int swap_in(vaddr_t v_addr, paddr_t p_addr, pid_t pid, uint8_t store);
 
 /*  swap_out
     vaddr_t   v_addr:           indirizzo logico della pagina
@@ -42,8 +46,46 @@ int swap_in(vaddr_t v_addr, pid_t pid, uint8_t store);
     paddr_t      p_addr:        physical address della pagina da 
                                 inserire nello SWAPFILE
     Prende una pagina dalla memoria e la inserisce nello SWAPFILE
+    Ritorna 0 in caso di successo, ENOSPC se lo SWAPFILE e' pieno
+*/
+int swap_out(vaddr_t v_addr, paddr_t p_addr, pid_t pid);
+
+/*  swap_reserve
+    vaddr_t   v_addr:           indirizzo logico della pagina
+    pid_t        pid:           pid del processo
+    Riserva uno slot dello SWAPFILE per la pagina, che da questo
+    momento risulta presente: chi prova a caricarla (o scartarla)
+    aspetta finche' swap_write_slot non l'ha scritta.
+    Ritorna lo slot riservato, -1 se lo SWAPFILE e' pieno.
+*/
+int swap_reserve(vaddr_t v_addr, pid_t pid);
+
+/*  swap_write_slot
+    int         slot:           slot ritornato da swap_reserve
+    paddr_t   p_addr:           physical address della pagina
+    Scrive la pagina nello slot e lo rende disponibile.
     (no return code)
 */
-void swap_out(vaddr_t v_addr, paddr_t p_addr, pid_t pid);
+void swap_write_slot(int slot, paddr_t p_addr);
+
+/*  swap_free_slots
+    Ritorna il numero di slot liberi dello SWAPFILE
+*/
+int swap_free_slots(void);
+
+/*  swap_discard_pid
+    pid_t        pid:           pid del processo
+    Scarta tutte le pagine del processo presenti nello SWAPFILE
+    (tranne quelle che si stanno ancora scrivendo).
+    Ritorna il numero di pagine scartate
+*/
+int swap_discard_pid(pid_t pid);
+
+/*  swap_usage
+    unsigned int *counts:       array di PID_MAX contatori
+    Aggiunge a counts[pid] il numero di pagine di ogni processo
+    presenti nello SWAPFILE
+*/
+void swap_usage(unsigned int *counts);
 
 #endif /* _SWAPFILE_H_ */
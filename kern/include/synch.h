@@ -58,9 +58,12 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *     sem_tryP: decrement count if it is not 0, without blocking;
+ *               returns true if it did.
  */
 void P(struct semaphore *);
 void V(struct semaphore *);
+bool sem_tryP(struct semaphore *);
 
 
 /*
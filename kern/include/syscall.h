@@ -36,6 +36,7 @@ struct trapframe; /* from <machine/trapframe.h> */
 
 #include <read_write_syscalls.h>    /* syscalls for read and write */
 #include <proc_syscalls.h>          /* syscalls for process management like sys__exit */
+#include <vm_syscalls.h>            /* syscalls for the address space like sbrk */
 /*
  * The system call dispatcher.
  */
@@ -108,6 +108,7 @@ struct thread {
 
 	/* add more here as needed */
   int exit_status;   /* field for saving the exit status of the thread */
+  unsigned int t_ptbusy;   /* page table slots this thread is filling (PT_BUSY_BIT) */
 };
 
 /*
@@ -0,0 +1,22 @@
+#ifndef __VM_SYSCALLS_H__
+#define __VM_SYSCALLS_H__
+
+#include "opt-paging.h"
+#include <types.h>
+#include <lib.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <kern/errno.h>
+#include "opt-read_write.h"
+
+#if OPT_PAGING
+int sys_sbrk(intptr_t amount);
+int sys_vmstat(pid_t pid, userptr_t counts, size_t ncounts);
+#if OPT_READ_WRITE
+int sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd, off_t offset);
+int sys_munmap(vaddr_t addr, size_t len);
+#endif
+#endif
+
+#endif
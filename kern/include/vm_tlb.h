@@ -1,7 +1,40 @@
 #ifndef _VM_TLB_H_
 #define _VM_TLB_H_
 
-int tlb_get_rr_victim(void);
-void tlb_insert(vaddr_t vaddr, paddr_t paddr);
+#include <vm.h>
+
+/* a batch of invalidations sent to the other CPUs with a single IPI each */
+struct tlb_batch {
+	pid_t tb_pid;                                   /* owner of the pages, 0 for kernel pages */
+	unsigned int tb_n;                              /* TLBSHOOTDOWN_MAX + 1 means flush everything */
+	struct tlbshootdown tb_ts[TLBSHOOTDOWN_MAX];
+};
+
+/* map vaddr to paddr in the TLB, writable only if dirty is set */
+void tlb_insert(vaddr_t vaddr, paddr_t paddr, int dirty);
 void tlb_invalidate(void);
+/* invalidate the whole TLB of this CPU without counting it in the statistics */
+void tlb_flush(void);
+/* drop the TLB entry of vaddr, if any */
+void tlb_invalidate_vaddr(vaddr_t vaddr);
+void tlb_invalidate_range(vaddr_t start, vaddr_t end);
+/* number of TLB misses served by the fast refill on all CPUs */
+unsigned int tlb_refill_count(void);
+/* map a kseg2 page: the entry is global, valid for every process */
+void tlb_insert_kernel(vaddr_t vaddr, paddr_t paddr);
+/* switch this CPU to process pid (0 = kernel thread), flushing the TLB if needed */
+void tlb_activate(pid_t pid);
+/* pid is gone: no CPU may reuse its entries for a new process with the same pid */
+void tlb_forget(pid_t pid);
+
+/* start a batch of invalidations of the pages of process pid (0 = kernel pages) */
+void tlb_batch_init(struct tlb_batch *tb, pid_t pid);
+/* add a page to the batch; past TLBSHOOTDOWN_MAX pages the batch becomes a full flush */
+void tlb_batch_add(struct tlb_batch *tb, vaddr_t vaddr);
+/* invalidate the batch on every CPU that may have the pages and wait for them (no spinlock held) */
+void tlb_batch_flush(struct tlb_batch *tb);
+/* invalidate the page vaddr of process pid on every CPU (no spinlock held) */
+void tlb_shootdown(vaddr_t vaddr, pid_t pid);
+/* flush the TLB of every CPU (no spinlock held) */
+void tlb_shootdown_all(void);
 #endif /* _VM_TLB_H_ */
\ No newline at end of file
@@ -0,0 +1,26 @@
+#ifndef _VMALLOC_H_
+#define _VMALLOC_H_
+
+#include <types.h>
+#include <lib.h>
+#include <vm.h>
+
+/* first address of the kseg2 window used for mapped kernel memory */
+#define KSEG2_BASE MIPS_KSEG2
+
+/* true if the address belongs to the mapped kernel window */
+#define IS_KSEG2(vaddr) ((vaddr_t)(vaddr) >= KSEG2_BASE)
+
+/* bootstrap for the kseg2 allocator (must be called before the coremap is active) */
+void vmalloc_bootstrap(unsigned int nframes);
+
+/* allocate npages of kernel memory backed by frames that need not be contiguous */
+vaddr_t vmalloc(unsigned int npages);
+
+/* free a region returned by vmalloc */
+void vfree(vaddr_t vaddr);
+
+/* reload the TLB entry of a kseg2 page (called by vm_fault) */
+int vmalloc_fault(vaddr_t vaddr);
+
+#endif /* _VMALLOC_H_ */
@@ -0,0 +1,31 @@
+#ifndef _VMTRACE_H_
+#define _VMTRACE_H_
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+
+/* how a page fault was served */
+#define VMT_RELOAD  0   /* page already in memory, only the TLB entry was missing */
+#define VMT_ZERO    1   /* zero-filled page (or shared zero page) */
+#define VMT_ELF     2   /* loaded from the program ELF file */
+#define VMT_MMAP    3   /* loaded from a mapped file */
+#define VMT_SWAPIN  4   /* read back from the swapfile */
+#define VMT_EVICT   5   /* any load that first had to write a victim page to the swapfile */
+#define VMT_NTYPES  6
+
+/* latency histograms: bucket b counts the faults that took [2^b, 2^(b+1)) ns */
+#define VMT_NBUCKETS 32
+/* faults remembered by each CPU */
+#define VMT_RINGSIZE 64
+
+/* record a fault of type path on vaddr of process pid, started at start */
+void vmt_record(int path, pid_t pid, vaddr_t vaddr, const struct timespec *start);
+
+/* print the histograms and the last faults of each CPU (menu command) */
+void vmt_print(void);
+
+/* clear histograms and trace */
+void vmt_reset(void);
+
+#endif /* _VMTRACE_H_ */
@@ -56,6 +56,7 @@
 #if OPT_PAGING
 #include <vmstats.h>
 #include <swapfile.h>
+#include <pt.h>
 #endif
 
 /*
@@ -222,6 +223,10 @@ sys_reboot(int code)
 void
 kmain(char *arguments)
 {
+#if OPT_PAGING
+	/* the page table geometry must be known before vm_bootstrap */
+	pt_boot_options(arguments);
+#endif
 	boot();
 
 	//hello task
@@ -31,6 +31,7 @@
 #include <kern/errno.h>
 #include <kern/reboot.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
 #include <uio.h>
@@ -47,6 +48,12 @@
 #include "opt-sfs.h"
 #include "opt-net.h"
 #include <opt-proc_manage.h>
+#include "opt-paging.h"
+#if OPT_PAGING
+#include <vmstats.h>
+#include <vmtrace.h>
+#include <pt.h>
+#endif
 /*
  * In-kernel menu and command dispatcher.
  */
@@ -118,13 +125,18 @@ common_prog(int nargs, char **args)
 	struct proc *proc;
 	int result;
 #if OPT_PROC_MANAGE
-	int exit_code;
+	int status;
+	pid_t pid;
 #endif
 	/* Create a process for the new program to run in. */
 	proc = proc_create_runprogram(args[0] /* name */);
 	if (proc == NULL) {
 		return ENOMEM;
 	}
+#if OPT_PROC_MANAGE
+	/* the process is destroyed as soon as it exits: only its pid is left to us */
+	pid = proc->pid;
+#endif
 
 	result = thread_fork(args[0] /* thread name */,
 			proc /* new process */,
@@ -133,12 +145,20 @@ common_prog(int nargs, char **args)
 	if (result) {
 		kprintf("thread_fork failed: %s\n", strerror(result));
 		proc_destroy(proc);
+#if OPT_PROC_MANAGE
+		proc_wait(pid);
+#endif
 		return result;
 	}
 
 #if OPT_PROC_MANAGE
-	exit_code = proc_wait(proc);
-	kprintf("Process exited with code: %d\n", exit_code);
+	status = proc_wait(pid);
+	if (WIFSIGNALED(status)) {
+		kprintf("Process killed by signal %d\n", WTERMSIG(status));
+	}
+	else {
+		kprintf("Process exited with code: %d\n", WEXITSTATUS(status));
+	}
 #endif
 	/*
 	 * The new process will be destroyed when the program exits...
@@ -544,6 +564,12 @@ static const char *opsmenu[] = {
 	"[panic]   Intentional panic         ",
 	"[deadlock] Intentional deadlock     ",
 	"[memstats] memory statistics        ",
+#if OPT_PAGING
+	"[vmstat]  VM stats per CPU/process  ",
+	"[vmtrace] Fault latency and trace   ",
+	"[ptstat]  Page table hash report    ",
+	"[ptconf]  Page table configuration  ",
+#endif
 	"[q]       Quit and shut down        ",
 	NULL
 };
@@ -632,6 +658,54 @@ static int cmd_memstats(int n, char**a){
   return 0;
 }
 
+#if OPT_PAGING
+static int cmd_vmstat(int n, char**a){
+  (void)a;
+  (void)n;
+
+  vms_print_detail();
+  return 0;
+}
+
+static int cmd_vmtrace(int n, char**a){
+  if (n > 1 && !strcmp(a[1], "reset")) {
+    vmt_reset();
+    return 0;
+  }
+  if (n > 1) {
+    kprintf("Usage: vmtrace [reset]\n");
+    return EINVAL;
+  }
+  vmt_print();
+  return 0;
+}
+
+static int cmd_ptstat(int n, char**a){
+  if (n > 2 || (n == 2 && strcmp(a[1], "-d"))) {
+    kprintf("Usage: ptstat [-d]\n");
+    return EINVAL;
+  }
+  pt_report(n == 2);
+  return 0;
+}
+
+static int cmd_ptconf(int n, char**a){
+  int result;
+
+  /* the geometry is chosen at boot (pt_boot_options), here it can only be checked */
+  result = pt_check_config(n - 1, a + 1);
+  if (result == EINVAL) {
+    kprintf("Usage: ptconf [2|4|8|16] [mod|mult|xor]\n");
+    return result;
+  }
+  if (result == EBUSY) {
+    kprintf("ptconf: the page table can only be configured in the boot arguments\n");
+  }
+  pt_print_config();
+  return result;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Command table.
@@ -670,6 +744,12 @@ static struct {
 	{ "khdump",     cmd_kheapdump },
 	/* memstat */
 	{ "memstats",   cmd_memstats },
+#if OPT_PAGING
+	{ "vmstat",     cmd_vmstat },
+	{ "vmtrace",    cmd_vmtrace },
+	{ "ptstat",     cmd_ptstat },
+	{ "ptconf",     cmd_ptconf },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
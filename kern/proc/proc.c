@@ -50,9 +50,16 @@
 #include <vnode.h>
 #include <limits.h>
 #include <opt-proc_manage.h>
+#include <kern/wait.h>
 
 #include <pt.h>
 #include <opt-paging.h>
+
+#if OPT_READ_WRITE
+#define FD_IS_USED(p, fd)    (((p)->p_fdused[(fd) / 32] >> ((fd) % 32)) & 1)
+#define FD_SET_USED(p, fd)   ((p)->p_fdused[(fd) / 32] |= (uint32_t)1 << ((fd) % 32))
+#define FD_CLEAR_USED(p, fd) ((p)->p_fdused[(fd) / 32] &= ~((uint32_t)1 << ((fd) % 32)))
+#endif
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
@@ -61,28 +68,58 @@ struct proc *kproc;
 #if OPT_PROC_MANAGE
 static struct spinlock process_table_lock=SPINLOCK_INITIALIZER;
 struct proc* processes[PID_MAX];
-static int last_pid=-1;
+
+/*
+ * Pids in use, a bit each, and the next pid to try. The hint moves
+ * forward past every pid handed out, so a pid that is freed is not
+ * reused until the hint has gone once around the table: a waitpid on
+ * a stale pid does not find an unrelated new process right away.
+ * The pid is still the index of the process in the table (and in the
+ * page table key and the per-pid VM counters), so it stays below
+ * PID_MAX.
+ */
+static uint32_t pid_used[(PID_MAX + 31) / 32];
+static int pid_hint = 0;
+
+#define PID_IS_USED(pid)    ((pid_used[(pid) / 32] >> ((pid) % 32)) & 1)
+#define PID_SET_USED(pid)   (pid_used[(pid) / 32] |= (uint32_t)1 << ((pid) % 32))
+#define PID_CLEAR_USED(pid) (pid_used[(pid) / 32] &= ~((uint32_t)1 << ((pid) % 32)))
+
+/* returns the first free pid at or after start (wrapping around), -1 if there is none */
+static int pid_find_free(int start){
+  int w, n, pid;
+
+  // the rest of the word of start, then whole words
+  for(pid = start; pid % 32 != 0 && pid < PID_MAX; pid++){
+    if(!PID_IS_USED(pid))
+      return pid;
+  }
+  for(n = 0, w = (pid % PID_MAX) / 32; n <= (PID_MAX + 31) / 32; n++, w = (w + 1) % ((PID_MAX + 31) / 32)){
+    if(pid_used[w] == 0xffffffff)
+      continue;
+    for(pid = w * 32; pid < PID_MAX && PID_IS_USED(pid); pid++)
+      ;
+    if(pid < PID_MAX)
+      return pid;
+  }
+  return -1;
+}
 
 static int add_proc(struct proc* p){
-  int start;
-  int assigned = 0;
+  int pid;
   spinlock_acquire(&process_table_lock);
-  start = (last_pid + 1) % PID_MAX;
-
-  while(start != last_pid){
-    if(processes[start] == NULL){
-      processes[start] = p;
-	  
-      p->pid = (pid_t)start;
-      assigned = 1;
-      last_pid = start;
-    }else
-      start = (start + 1) % PID_MAX;
+  pid = pid_find_free(pid_hint);
+  if(pid >= 0){
+    PID_SET_USED(pid);
+    processes[pid] = p;
+    p->pid = (pid_t)pid;
+    pid_hint = (pid + 1) % PID_MAX;
   }
   spinlock_release(&process_table_lock);
-  return assigned;
+  return pid >= 0;
 }
 
+/* take p out of the table; its pid stays taken until its exit status is released */
 static void remove_proc(pid_t pid){
   if(pid >= PID_MAX || pid < 0)
     return;
@@ -91,12 +128,219 @@ static void remove_proc(pid_t pid){
   spinlock_release(&process_table_lock);
 }
 
-struct proc* get_proc_by_pid(pid_t pid){
-  if(pid >= PID_MAX || pid < 0)
+static void pid_release(pid_t pid){
+  spinlock_acquire(&process_table_lock);
+  PID_CLEAR_USED(pid);
+  spinlock_release(&process_table_lock);
+}
+
+/*
+ * What is left of a process after it exits, until its parent reaps
+ * it: the process itself (address space, files and all) is destroyed
+ * as soon as it exits. The record is shared by the process and its
+ * parent, each holding a reference; the pid stays taken until both
+ * have dropped theirs. The children of a process are a list of these
+ * records, so waitpid only looks at the children of the caller.
+ */
+struct proc_status{
+  pid_t ps_pid;
+  pid_t ps_ppid;		/* 0 once the parent is gone */
+  int ps_status;		/* wait status (_MKWAIT_*), once ps_exited */
+  bool ps_exited;
+  unsigned ps_refs;
+  struct spinlock ps_lock;	/* protects the fields above */
+  struct semaphore* ps_sem;	/* V'd at exit */
+  struct proc_status* ps_next;	/* next child of the parent (under its p_lock) */
+};
+
+static struct proc_status* ps_create(pid_t pid){
+  struct proc_status* ps;
+
+  ps = kmalloc(sizeof(struct proc_status));
+  if(ps == NULL)
+    return NULL;
+  ps->ps_sem = sem_create("exit", 0);
+  if(ps->ps_sem == NULL){
+    kfree(ps);
     return NULL;
-  return processes[pid];
+  }
+  ps->ps_pid = pid;
+  ps->ps_ppid = 0;
+  ps->ps_status = 0;
+  ps->ps_exited = false;
+  ps->ps_refs = 1;
+  spinlock_init(&ps->ps_lock);
+  ps->ps_next = NULL;
+  return ps;
 }
 
+/* drop a reference to the record, freeing it and its pid with the last one */
+static void ps_release(struct proc_status* ps){
+  unsigned refs;
+
+  spinlock_acquire(&ps->ps_lock);
+  refs = --ps->ps_refs;
+  spinlock_release(&ps->ps_lock);
+  if(refs > 0)
+    return;
+  pid_release(ps->ps_pid);
+  sem_destroy(ps->ps_sem);
+  spinlock_cleanup(&ps->ps_lock);
+  kfree(ps);
+}
+
+/* make child a child of parent (whose p_children list it joins) */
+void proc_add_child(struct proc* parent, struct proc* child){
+  struct proc_status* ps = child->p_status;
+
+  spinlock_acquire(&ps->ps_lock);
+  ps->ps_refs++;
+  ps->ps_ppid = parent->pid;
+  spinlock_release(&ps->ps_lock);
+
+  spinlock_acquire(&parent->p_lock);
+  ps->ps_next = parent->p_children;
+  parent->p_children = ps;
+  spinlock_release(&parent->p_lock);
+}
+
+/* pid of the parent of p, 0 if it has gone */
+pid_t proc_getppid(struct proc* p){
+  pid_t ppid;
+
+  spinlock_acquire(&p->p_status->ps_lock);
+  ppid = p->p_status->ps_ppid;
+  spinlock_release(&p->p_status->ps_lock);
+  return ppid;
+}
+
+/*
+ * Wait for child pid of the current process to exit (unless options
+ * has WNOHANG), reap it and put its wait status in *status. Returns
+ * pid, 0 if WNOHANG was given and the child is still running, -ECHILD
+ * if pid is not a child of the caller.
+ */
+pid_t proc_wait_child(pid_t pid, int options, int* status){
+  struct proc* p = curproc;
+  struct proc_status *ps, **pp;
+  bool exited;
+
+  spinlock_acquire(&p->p_lock);
+  for(ps = p->p_children; ps != NULL && ps->ps_pid != pid; ps = ps->ps_next)
+    ;
+  spinlock_release(&p->p_lock);
+  if(ps == NULL)
+    return -ECHILD;
+
+  spinlock_acquire(&ps->ps_lock);
+  exited = ps->ps_exited;
+  spinlock_release(&ps->ps_lock);
+  if(!exited){
+    if(options & WNOHANG)
+      return 0;
+    P(ps->ps_sem);
+  }
+  *status = ps->ps_status;
+
+  spinlock_acquire(&p->p_lock);
+  for(pp = &p->p_children; *pp != ps; pp = &(*pp)->ps_next)
+    ;
+  *pp = ps->ps_next;
+  spinlock_release(&p->p_lock);
+  ps_release(ps);
+  return pid;
+}
+
+/* publish the exit of proc to its parent and let go of its children (from proc_destroy) */
+static void proc_exit_status(struct proc* proc){
+  struct proc_status *ps, *next;
+
+  spinlock_acquire(&proc->p_lock);
+  ps = proc->p_children;
+  proc->p_children = NULL;
+  spinlock_release(&proc->p_lock);
+  for(; ps != NULL; ps = next){
+    next = ps->ps_next;
+    spinlock_acquire(&ps->ps_lock);
+    ps->ps_ppid = 0;
+    spinlock_release(&ps->ps_lock);
+    ps_release(ps);
+  }
+
+  ps = proc->p_status;
+  spinlock_acquire(&ps->ps_lock);
+  ps->ps_status = proc->exit_status;
+  ps->ps_exited = true;
+  spinlock_release(&ps->ps_lock);
+  V(ps->ps_sem);
+  ps_release(ps);
+}
+
+/* give p the name name (a kmalloc'd string, which p takes over) */
+void proc_rename(struct proc* p, char* name){
+  char* old;
+
+  // the name is read under the table lock (vmstats)
+  spinlock_acquire(&process_table_lock);
+  old = p->p_name;
+  p->p_name = name;
+  spinlock_release(&process_table_lock);
+  kfree(old);
+}
+
+#if OPT_PAGING
+/* copy the VM counters (and the name, if name is not NULL) of process pid; ESRCH if there is none */
+int proc_vmstats(pid_t pid, unsigned int *counts, char *name, size_t namelen){
+  struct proc *p;
+
+  if(pid >= PID_MAX || pid < 0)
+    return ESRCH;
+  spinlock_acquire(&process_table_lock);
+  p = processes[pid];
+  if(p == NULL){
+    spinlock_release(&process_table_lock);
+    return ESRCH;
+  }
+  memcpy(counts, p->p_vmstats, sizeof(p->p_vmstats));
+  if(name != NULL)
+    snprintf(name, namelen, "%s", p->p_name);
+  spinlock_release(&process_table_lock);
+  return 0;
+}
+
+/* true if process pid was marked by the OOM killer and still has its address space */
+bool proc_oom_pending(pid_t pid){
+  bool pending;
+
+  if(pid >= PID_MAX || pid < 0)
+    return false;
+  spinlock_acquire(&process_table_lock);
+  pending = processes[pid] != NULL && processes[pid]->p_oomkilled &&
+    processes[pid]->p_addrspace != NULL;
+  spinlock_release(&process_table_lock);
+  return pending;
+}
+
+/* mark the user process with the most pages (pages[pid]) for the OOM killer; returns its pid, -1 if none */
+pid_t proc_oom_mark(const unsigned int *pages){
+  pid_t pid, victim = -1;
+
+  spinlock_acquire(&process_table_lock);
+  for(pid = 0; pid < PID_MAX; pid++){
+    if(processes[pid] == NULL || processes[pid] == kproc || processes[pid]->p_oomkilled)
+      continue;
+    if(processes[pid]->p_addrspace == NULL || pages[pid] == 0)
+      continue;
+    if(victim < 0 || pages[pid] > pages[victim])
+      victim = pid;
+  }
+  if(victim >= 0)
+    processes[victim]->p_oomkilled = true;
+  spinlock_release(&process_table_lock);
+  return victim;
+}
+#endif
+
 #endif
 /*
  * Create a proc structure.
@@ -116,8 +360,9 @@ proc_create(const char *name)
 		kfree(proc);
 		return NULL;
 	}
+	proc->exit_status = 0;
 #if OPT_PROC_MANAGE
-	proc->ended_sem = NULL;
+	proc->p_children = NULL;
 
 	/* assign pid*/
 	if(!add_proc(proc)){
@@ -125,12 +370,25 @@ proc_create(const char *name)
 	  kfree(proc);
 	  return NULL;
 	}
+	proc->p_status = ps_create(proc->pid);
+	if(proc->p_status == NULL){
+	  remove_proc(proc->pid);
+	  pid_release(proc->pid);
+	  kfree(proc->p_name);
+	  kfree(proc);
+	  return NULL;
+	}
 #endif
 #if OPT_READ_WRITE
 	int i;
 	for(i=0;i<OPEN_MAX;i++){
 	  proc->open_files[i] = NULL;
 	}
+	bzero(proc->p_fdused, sizeof(proc->p_fdused));
+	/* the console descriptors are handled by the system calls */
+	for(i=0;i<=STDERR_FILENO;i++){
+	  FD_SET_USED(proc, i);
+	}
 #endif
 
 	proc->p_numthreads = 0;
@@ -143,11 +401,34 @@ proc_create(const char *name)
 	proc->p_cwd = NULL;
 #if OPT_PAGING
 	proc->p_elf = NULL;
+	bzero(proc->p_vmstats, sizeof(proc->p_vmstats));
+	proc->p_oomkilled = false;
 #endif
 	return proc;
 }
 
 #if OPT_PROC_MANAGE
+/* give new_proc the cwd and the descriptors of proc, and make it a child of proc */
+static void proc_inherit(struct proc* proc, struct proc* new_proc){
+  /* setup cwd */
+  VOP_INCREF(proc->p_cwd);
+  new_proc->p_cwd = proc->p_cwd;
+  // copy open file table
+#if OPT_READ_WRITE
+  int i;
+  spinlock_acquire(&proc->p_lock);
+  for(i=0;i<OPEN_MAX;i++){
+    new_proc->open_files[i] = proc->open_files[i];
+    if(new_proc->open_files[i] != NULL)
+      openfile_incref(new_proc->open_files[i]);
+  }
+  memcpy(new_proc->p_fdused, proc->p_fdused, sizeof(proc->p_fdused));
+  spinlock_release(&proc->p_lock);
+#endif
+  /* setup parent */
+  proc_add_child(proc, new_proc);
+}
+
 struct proc* proc_dup(struct proc* proc){
   struct addrspace* old_addrspace;
   struct addrspace* new_addrspace;
@@ -156,6 +437,8 @@ struct proc* proc_dup(struct proc* proc){
   if(proc == NULL)
     return NULL;
   new_proc = proc_create(proc->p_name);
+  if(new_proc == NULL)
+    return NULL;
   /* addresspace copy */
   old_addrspace = proc_getas();
   if(as_copy(old_addrspace, &new_addrspace) != 0){
@@ -163,27 +446,25 @@ struct proc* proc_dup(struct proc* proc){
     return NULL;
   }
   new_proc->p_addrspace = new_addrspace;
-  /* init the end semaphore */
-  new_proc->ended_sem = sem_create("", 0);
-  /* setup cwd */
-  VOP_INCREF(proc->p_cwd);
-  new_proc->p_cwd = proc->p_cwd;
-  // copy open file table
-#if OPT_READ_WRITE
-  int i;
-  for(i=0;i<OPEN_MAX;i++){
-    new_proc->open_files[i] = proc->open_files[i];
-  }
-#endif
 #if OPT_PAGING
 	new_proc->p_elf = proc->p_elf;
 	vnode_incref(new_proc->p_elf);
 #endif
-  /* setup parent */
-  new_proc->parent = proc;
+  proc_inherit(proc, new_proc);
   return new_proc;  
 }
 
+/* child of proc named name, with the cwd and descriptors of proc but no address space yet */
+struct proc* proc_spawn(struct proc* proc, const char* name){
+  struct proc* new_proc;
+
+  new_proc = proc_create(name);
+  if(new_proc == NULL)
+    return NULL;
+  proc_inherit(proc, new_proc);
+  return new_proc;
+}
+
 #endif
 /*
  * Destroy a proc structure.
@@ -217,11 +498,13 @@ proc_destroy(struct proc *proc)
 		proc->p_cwd = NULL;
 	}
 #if OPT_READ_WRITE
-	// close all opened files
+	// close all opened files (of proc, which need not be curproc)
 	int i;
 	for(i=0;i<OPEN_MAX;i++){
-	  if(proc->open_files[i] != NULL)
-	    sys_close(i);
+	  if(proc->open_files[i] != NULL){
+	    openfile_release(proc->open_files[i]);
+	    proc->open_files[i] = NULL;
+	  }
 	}
 #endif
 	/* VM fields */
@@ -276,14 +559,16 @@ proc_destroy(struct proc *proc)
 	}
 
 	KASSERT(proc->p_numthreads == 0);
-	spinlock_cleanup(&proc->p_lock);
 #if OPT_PROC_MANAGE
-	if(proc->ended_sem != NULL)
-	  sem_destroy(proc->ended_sem);
 	remove_proc(proc->pid);
+	proc_exit_status(proc);
 #endif
+	spinlock_cleanup(&proc->p_lock);
 #if OPT_PAGING
-	vfs_close(proc->p_elf);
+	/* NULL if fork failed before copying it */
+	if (proc->p_elf != NULL) {
+		vfs_close(proc->p_elf);
+	}
 #endif
 	kfree(proc->p_name);
 	kfree(proc);
@@ -300,6 +585,11 @@ proc_bootstrap(void)
   for(i=0;i<PID_MAX;i++){
     		processes[i]=NULL;
   }
+  /* the kernel gets pid 0, user processes start from PID_MIN */
+  bzero(pid_used, sizeof(pid_used));
+  for(i=1;i<PID_MIN;i++){
+    PID_SET_USED(i);
+  }
 #endif
 	kproc = proc_create("[kernel]");
 	if (kproc == NULL) {
@@ -328,9 +618,8 @@ proc_create_runprogram(const char *name)
 	newproc->p_addrspace = NULL;
 
 #if OPT_PROC_MANAGE
-	/* create the semaphore needed to wait for the proc*/
-	newproc->ended_sem = sem_create("", 0);
-	newproc->parent = curproc;
+	/* the menu waits for it */
+	proc_add_child(curproc, newproc);
 #endif
 
 	/* VFS fields */
@@ -450,53 +739,49 @@ proc_setas(struct addrspace *newas)
 
 #if OPT_PROC_MANAGE
 
-int proc_wait(struct proc* p){
+int proc_wait(pid_t pid){
   int status;
-  KASSERT(p!=NULL);
-  /* wait for process end*/
-  P(p->ended_sem);
-  /* get status*/
-  status = p->exit_status;
-  /* destroy the process */
-  proc_destroy(p);
-  /* return end status*/
+
+  /* wait for process end and reap it */
+  if(proc_wait_child(pid, 0, &status) < 0)
+    return -1;
   return status;
 }
 #endif
 
 #if OPT_READ_WRITE
 int proc_add_file(struct openfile* file){
-  int i, fd=-1;
+  int w, fd=-1;
   spinlock_acquire(&curproc->p_lock);
-  // check if already present entry
-  for(i = STDERR_FILENO + 1; i < OPEN_MAX; i++){
-    if(curproc->open_files[i] == file){
-      fd = i;
+  // lowest free descriptor: first word with a clear bit, then its lowest clear bit
+  for(w = 0; w < (OPEN_MAX + 31) / 32; w++){
+    if(curproc->p_fdused[w] != 0xffffffff){
+      for(fd = w * 32; FD_IS_USED(curproc, fd); fd++)
+	;
       break;
     }
   }
-  for(i = STDERR_FILENO + 1; i < OPEN_MAX && fd < 0; i++){
-    if(curproc->open_files[i] == NULL){
-      fd = i;
-      curproc->open_files[i] = file;
-      break;
-    }
+  if(fd >= 0 && fd < OPEN_MAX){
+    FD_SET_USED(curproc, fd);
+    curproc->open_files[fd] = file;
+  }else{
+    fd = -EMFILE;
   }
   spinlock_release(&curproc->p_lock);
-  if(i == OPEN_MAX)
-    return -EMFILE;
   return fd;
 }
 
 struct openfile* proc_rem_file(int fd){
   struct openfile* file;
-  if(fd >= OPEN_MAX || fd < 0){
+  if(fd >= OPEN_MAX || fd <= STDERR_FILENO){
     return NULL;
   }
 
   spinlock_acquire(&curproc->p_lock);
   file = curproc->open_files[fd];
   curproc->open_files[fd] = NULL;
+  if(file != NULL)
+    FD_CLEAR_USED(curproc, fd);
   spinlock_release(&curproc->p_lock);
   return file;
 }
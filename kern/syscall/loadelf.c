@@ -267,7 +267,13 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return result;
 		}
 	}
-#if !OPT_PAGING
+#if OPT_PAGING
+	/* pages are loaded on demand: only let the address space add its own regions (heap) */
+	result = as_complete_load(as);
+	if (result) {
+		return result;
+	}
+#else
 	result = as_prepare_load(as);
 	if (result) {
 		return result;
@@ -323,79 +329,64 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 
 #if OPT_PAGING
 
-int load_page(vaddr_t vaddr, int is_executable){
-	struct addrspace *as = proc_getas();
-	struct vnode* elf = curproc->p_elf;
+int fill_page(struct segment *seg, vaddr_t vaddr, paddr_t paddr, int *fromfile){
+	struct vnode* v = (seg->s_backing == SEG_BACKING_FILE) ? seg->s_vnode : curproc->p_elf;
 	struct iovec iov;
 	struct uio u;
 	int result;
 	off_t offset;
 	size_t filesize;
-	vaddr_t read_start;
-
-	// find segment
-	if(vaddr >= as->as_vbase1 && vaddr < (as->as_vbase1 + (as->as_npages1 * PAGE_SIZE))){
-		if(as->as_elfbase1 > vaddr)
-			read_start = as->as_elfbase1;
-		else 
-			read_start = vaddr;
-		offset = as->as_offset1 + vaddr - as->as_vbase1;
-		if((vaddr + PAGE_SIZE - as->as_vbase1) > as->as_filesize1){
-			if(vaddr - as->as_vbase1 > as->as_filesize1)
-				filesize = 0;
-			else
-				filesize =  as->as_filesize1 - (vaddr - as->as_vbase1);
-		}else{
-			filesize = PAGE_SIZE;
-		}
-		//filesize = (vaddr + PAGE_SIZE - as->as_vbase1 > as->as_filesize1)? as->as_filesize1 - (vaddr - as->as_vbase1) : PAGE_SIZE;
-	}
-	else if(vaddr >= as->as_vbase2 && vaddr < (as->as_vbase2 + (as->as_npages2 * PAGE_SIZE))){
-		
-		if(as->as_elfbase2 > vaddr)
-			read_start = as->as_elfbase2;
-		else 
-			read_start = vaddr;
-		offset = as->as_offset2 + vaddr - as->as_vbase2;
-		if((vaddr + PAGE_SIZE - as->as_vbase2) > as->as_filesize2){
-			if(vaddr - as->as_vbase2 > as->as_filesize2)
-				filesize = 0;
-			else
-				filesize =  as->as_filesize2 - (vaddr - as->as_vbase2);
-		}else{
-			filesize = PAGE_SIZE;
-		}
-		//filesize = (vaddr + PAGE_SIZE - as->as_vbase2 > as->as_filesize2)? as->as_filesize2 - (vaddr - as->as_vbase2) : PAGE_SIZE;
-	}
-	else{
-    	bzero((void *)vaddr, PAGE_SIZE);
-		vms_update(VMS_FAULTS_ZEROED);
+	vaddr_t read_start, read_end;
+	vaddr_t kvaddr = PADDR_TO_KVADDR(paddr);
+
+	/* the frame may hold data of another process: clear it through kseg0 */
+	bzero((void *)kvaddr, PAGE_SIZE);
+	*fromfile = 0;
+
+	/* part of the page covered by file data: [read_start, read_end) */
+	read_start = (seg->s_elfbase > vaddr) ? seg->s_elfbase : vaddr;
+	read_end = (seg->s_elfbase + seg->s_filesize < vaddr + PAGE_SIZE) ? seg->s_elfbase + seg->s_filesize : vaddr + PAGE_SIZE;
+
+	if(seg->s_backing == SEG_BACKING_ZERO || read_end <= read_start){
 		return 0;
 	}
+	offset = seg->s_offset + (read_start - seg->s_elfbase);
+	filesize = read_end - read_start;
 
-	iov.iov_ubase = (userptr_t)read_start;
-	iov.iov_len = PAGE_SIZE;		 // length of the memory space
-	u.uio_iov = &iov;
-	u.uio_iovcnt = 1;
-	u.uio_resid = filesize;          // amount to read from the file
-	u.uio_offset = offset;
-	u.uio_segflg = is_executable ? UIO_USERISPACE : UIO_USERSPACE;
-	u.uio_rw = UIO_READ;
-	u.uio_space = as;
+	uio_kinit(&iov, &u, (void *)(kvaddr + (read_start - vaddr)), filesize, offset, UIO_READ);
 
-	result = VOP_READ(elf, &u);
+	result = VOP_READ(v, &u);
 	if (result) {
 		return result;
 	}
 
-	if (u.uio_resid != 0) {
+	if (u.uio_resid != 0 && seg->s_backing == SEG_BACKING_ELF) {
 		/* short read; problem with executable? */
 		kprintf("ELF: short read on segment - file truncated?\n");
 		return ENOEXEC;
 	}
+	/* a mapped file may have been truncated: the rest of the page stays zero */
+	*fromfile = 1;
+	return 0;
+}
+
+int load_page(struct segment *seg, vaddr_t vaddr, paddr_t paddr){
+	int result, fromfile;
+
+	result = fill_page(seg, vaddr, paddr, &fromfile);
+	if (result) {
+		return result;
+	}
 	// update stats
-    vms_update(VMS_FAULTS_DISK);
-	vms_update(VMS_FAULTS_ELF);
+	if (!fromfile) {
+		vms_update(VMS_FAULTS_ZEROED);
+		return 0;
+	}
+	vms_update(VMS_FAULTS_DISK);
+	if (seg->s_backing == SEG_BACKING_FILE)
+		vms_update(VMS_FAULTS_MMAP);
+	else
+		vms_update(VMS_FAULTS_ELF);
 	return 0;
 }
-#endif
\ No newline at end of file
+#endif
@@ -3,8 +3,27 @@
 #include <synch.h>
 #include <syscall.h>
 #include <kern/errno.h>
+#include <kern/fcntl.h>
+#include <kern/wait.h>
+#include <signal.h>
+#include <limits.h>
+#include <vfs.h>
+#include <copyinout.h>
+#include "opt-paging.h"
+#if OPT_PAGING
+#include <pt.h>
+#endif
 
 void sys__exit(int code){
+  proc_exit(_MKWAIT_EXIT(code));
+}
+
+/*
+ * Terminate the current process with wait status status. With
+ * process management the process is destroyed right away (address
+ * space, files, cwd): only its exit status is kept for the parent.
+ */
+void proc_exit(int status){
   struct thread *actual_thread = curthread;
   struct proc *actual_proc = actual_thread->t_proc;
   KASSERT(actual_proc != NULL);
@@ -13,13 +32,12 @@ void sys__exit(int code){
   KASSERT(actual_as != NULL);
 #endif
   /* save exit satus of the process and thread */
-  actual_proc->exit_status = code;
-  actual_thread->exit_status = code;
+  actual_proc->exit_status = status;
+  actual_thread->exit_status = status;
 #if OPT_PROC_MANAGE
-  /* detach thread */
+  /* detach thread, then free everything but the exit status (and wake up the parent) */
   proc_remthread(actual_thread);
-  /* signal exit */
-  V(actual_proc->ended_sem);
+  proc_destroy(actual_proc);
 #else
   /* destroy address space */
   as_destroy(actual_as);
@@ -33,15 +51,20 @@ void sys__exit(int code){
 
 
 #if OPT_PROC_MANAGE
-pid_t sys_waitpid(pid_t pid, int* status, int options){
-  struct proc* proc;
-  /* get the process from table by pid*/
-  proc = get_proc_by_pid(pid);
-  if(proc == NULL)
-    return ECHILD;
-  /* wait for process termination and status setting*/
-  *status = proc_wait(proc);
-  (void)options;
+pid_t sys_waitpid(pid_t pid, userptr_t status, int options){
+  int kstatus, result;
+
+  if(options & ~WNOHANG)
+    return -EINVAL;
+  /* only children of the caller, found in its own list */
+  pid = proc_wait_child(pid, options, &kstatus);
+  if(pid <= 0)
+    return pid;
+  if(status != NULL){
+    result = copyout(&kstatus, status, sizeof(int));
+    if(result)
+      return -result;
+  }
   return pid;
 }
 
@@ -49,7 +72,7 @@ pid_t sys_getpid(void){
   return curproc->pid;
 }
 pid_t sys_getppid(void){
-  return curproc->parent->pid;
+  return proc_getppid(curproc);
 }
 static void enter_forked_process_wrapper(void* tf, unsigned long i){
   enter_forked_process((struct trapframe*)tf);
@@ -76,11 +99,300 @@ pid_t sys_fork(struct trapframe* tf){
   result = thread_fork(curthread->t_name, new_proc, enter_forked_process_wrapper, child_tf, 1);
 
   if(result){
+    int status;
     proc_destroy(new_proc);
+    /* reap it right away */
+    proc_wait_child(pid, 0, &status);
     kfree(child_tf);
     return -ENOMEM;
   }
   
   return pid;
 }
+
+/*
+ * execv arguments are gathered in a kernel buffer of ARG_MAX bytes laid
+ * out as the new user stack will be: the argv array (argc pointers and
+ * a NULL) followed by the strings. The user argv array is copied in a
+ * page at a time straight into the array slots, then each string is
+ * copied after the array and its slot is turned into the offset of the
+ * string; exec_args_fix turns the offsets into user addresses, and the
+ * whole block goes out with a single copyout.
+ */
+static int exec_args_copyin(userptr_t uargv, char* kbuf, int* argc, size_t* len){
+  userptr_t* slots = (userptr_t*)kbuf;
+  size_t max = ARG_MAX / sizeof(userptr_t), n = 0, chunk, i, pos, got;
+  vaddr_t uaddr;
+  int result;
+
+  if(uargv == NULL || ((vaddr_t)uargv % sizeof(userptr_t)) != 0)
+    return EFAULT;
+  // the array: up to the end of the page of each piece, so that no copyin runs into an unmapped page
+  while(1){
+    uaddr = (vaddr_t)uargv + n * sizeof(userptr_t);
+    chunk = (PAGE_SIZE - (uaddr & ~PAGE_FRAME)) / sizeof(userptr_t);
+    if(chunk > max - n)
+      chunk = max - n;
+    if(chunk == 0)
+      return E2BIG;
+    result = copyin((const_userptr_t)uaddr, &slots[n], chunk * sizeof(userptr_t));
+    if(result)
+      return result;
+    for(i = n; i < n + chunk && slots[i] != NULL; i++)
+      ;
+    if(i < n + chunk){
+      n = i;
+      break;
+    }
+    n += chunk;
+  }
+  // the strings, right after the array
+  pos = (n + 1) * sizeof(userptr_t);
+  for(i = 0; i < n; i++){
+    if(pos >= ARG_MAX)
+      return E2BIG;
+    result = copyinstr((const_userptr_t)slots[i], kbuf + pos, ARG_MAX - pos, &got);
+    if(result)
+      return result == ENAMETOOLONG ? E2BIG : result;
+    slots[i] = (userptr_t)pos;
+    pos += got;
+  }
+  slots[n] = NULL;
+  *argc = n;
+  // the stack pointer must stay 8-byte aligned
+  *len = (pos + 7) & ~(size_t)7;
+  if(*len > ARG_MAX)
+    return E2BIG;
+  return 0;
+}
+
+/* turn the string offsets of the argv array into addresses, for the block copied out at base */
+static void exec_args_fix(char* kbuf, int argc, vaddr_t base){
+  userptr_t* slots = (userptr_t*)kbuf;
+  int i;
+
+  for(i = 0; i < argc; i++)
+    slots[i] = (userptr_t)(base + (vaddr_t)slots[i]);
+}
+
+/*
+ * Gather what execv and spawn need from the user: the program path
+ * (opened in *v, and kept as *name for the new image) and the argument
+ * block (exec_args_copyin). On error nothing is left allocated.
+ */
+static int exec_prepare(userptr_t upath, userptr_t uargv, struct vnode** v,
+                        char** name, char** kbuf, int* argc, size_t* len){
+  char* kpath;
+  int result;
+
+  kpath = kmalloc(PATH_MAX);
+  *kbuf = kmalloc(ARG_MAX);
+  if(kpath == NULL || *kbuf == NULL){
+    kfree(kpath);
+    kfree(*kbuf);
+    return ENOMEM;
+  }
+  result = copyinstr((const_userptr_t)upath, kpath, PATH_MAX, NULL);
+  if(result == 0 && kpath[0] == '\0')
+    result = EINVAL;
+  if(result == 0)
+    result = exec_args_copyin(uargv, *kbuf, argc, len);
+  // vfs_open may destroy the path
+  *name = result == 0 ? kstrdup(kpath) : NULL;
+  if(result == 0 && *name == NULL)
+    result = ENOMEM;
+  if(result == 0)
+    result = vfs_open(kpath, O_RDONLY, 0, v);
+  kfree(kpath);
+  if(result){
+    kfree(*name);
+    kfree(*kbuf);
+  }
+  return result;
+}
+
+/*
+ * Replace the image of the current process. Everything that can fail
+ * (arguments, file, ELF headers, new regions) is done while the old
+ * address space is still there to go back to; only then the pages of
+ * the old one are dropped, through the touched range of each of its
+ * regions, and it is destroyed. With paging the new image is loaded on
+ * demand from the ELF file, which becomes the p_elf of the process.
+ * The pid, the descriptors and the cwd are kept.
+ */
+int sys_execv(userptr_t upath, userptr_t uargv){
+  struct addrspace *old_as, *new_as;
+  struct vnode* v;
+#if OPT_PAGING
+  struct vnode* old_elf;
+#endif
+  vaddr_t entrypoint, stackptr;
+  char *kbuf, *name;
+  size_t len;
+  int argc, result;
+
+  result = exec_prepare(upath, uargv, &v, &name, &kbuf, &argc, &len);
+  if(result)
+    return -result;
+
+  new_as = as_create();
+  if(new_as == NULL){
+    vfs_close(v);
+    kfree(name);
+    kfree(kbuf);
+    return -ENOMEM;
+  }
+  old_as = proc_setas(new_as);
+  as_activate();
+#if OPT_PAGING
+  old_elf = curproc->p_elf;
+  curproc->p_elf = v;
+#endif
+  result = load_elf(v, &entrypoint);
+  if(result == 0)
+    result = as_define_stack(new_as, &stackptr);
+  if(result){
+    // back to the old image
+    proc_setas(old_as);
+    as_activate();
+#if OPT_PAGING
+    curproc->p_elf = old_elf;
+#endif
+    as_destroy(new_as);
+    vfs_close(v);
+    kfree(name);
+    kfree(kbuf);
+    return -result;
+  }
+
+  // no way back: the old image goes away (its pages have the same pid as the new ones)
+#if OPT_PAGING
+  pt_delete_PID(old_as, curproc->pid);
+  if(old_elf != NULL)
+    vfs_close(old_elf);
+#else
+  vfs_close(v);
+#endif
+  as_destroy(old_as);
+
+  proc_rename(curproc, name);
+
+  stackptr -= len;
+  exec_args_fix(kbuf, argc, stackptr);
+  result = copyout(kbuf, (userptr_t)stackptr, len);
+  kfree(kbuf);
+  if(result){
+    // the arguments fit the stack limit: only running out of memory gets here
+    proc_exit(_MKWAIT_SIG(SIGKILL));
+  }
+
+  enter_new_process(argc, (userptr_t)stackptr, NULL, stackptr, entrypoint);
+  panic("enter_new_process returned\n");
+  return -EINVAL;
+}
+
+/* handed by sys_spawn to the first thread of the new process */
+struct spawn_args {
+  struct vnode* sa_vnode;       /* the program, owned by the child from now on */
+  char* sa_kbuf;                /* argument block (exec_args_copyin), owned by the parent */
+  int sa_argc;
+  size_t sa_len;
+  struct semaphore* sa_sem;     /* V'd by the child once its image is set up (or failed) */
+  int sa_result;
+};
+
+/*
+ * First thread of a spawned process: build the image the way execv
+ * does, but into an empty process. The parent is waiting on sa_sem and
+ * gets the result; on failure the child exits and the parent reaps it.
+ */
+static void spawn_start(void* data, unsigned long unused){
+  struct spawn_args* sa = data;
+  struct addrspace* as;
+  vaddr_t entrypoint = 0, stackptr = 0;
+  int argc = sa->sa_argc, result;
+
+  (void)unused;
+  as = as_create();
+  if(as == NULL){
+    vfs_close(sa->sa_vnode);
+    result = ENOMEM;
+  }
+  else{
+    proc_setas(as);
+    as_activate();
+#if OPT_PAGING
+    // freed with the process if anything below fails
+    curproc->p_elf = sa->sa_vnode;
+#endif
+    result = load_elf(sa->sa_vnode, &entrypoint);
+#if !OPT_PAGING
+    vfs_close(sa->sa_vnode);
+#endif
+    if(result == 0)
+      result = as_define_stack(as, &stackptr);
+    if(result == 0){
+      stackptr -= sa->sa_len;
+      exec_args_fix(sa->sa_kbuf, argc, stackptr);
+      result = copyout(sa->sa_kbuf, (userptr_t)stackptr, sa->sa_len);
+    }
+  }
+  // sa belongs to the parent again after this
+  sa->sa_result = result;
+  V(sa->sa_sem);
+  if(result)
+    proc_exit(_MKWAIT_SIG(SIGKILL));
+
+  enter_new_process(argc, (userptr_t)stackptr, NULL, stackptr, entrypoint);
+  panic("enter_new_process returned\n");
+}
+
+/*
+ * Create a child running the program at upath with arguments uargv,
+ * like fork followed by execv in the child, but without ever copying
+ * the address space of the caller: the child starts empty, with the
+ * cwd and the descriptors of the caller, and loads the program itself.
+ * The caller waits until the image is set up, so that errors (missing
+ * file, bad ELF, out of memory) are returned here and not as an exit
+ * status. Returns the pid of the child.
+ */
+pid_t sys_spawn(userptr_t upath, userptr_t uargv){
+  struct spawn_args sa;
+  struct proc* new_proc;
+  char* name;
+  pid_t pid;
+  int status, result;
+
+  result = exec_prepare(upath, uargv, &sa.sa_vnode, &name, &sa.sa_kbuf, &sa.sa_argc, &sa.sa_len);
+  if(result)
+    return -result;
+  sa.sa_sem = sem_create("spawn", 0);
+  new_proc = sa.sa_sem == NULL ? NULL : proc_spawn(curproc, name);
+  kfree(name);
+  if(new_proc == NULL){
+    if(sa.sa_sem != NULL)
+      sem_destroy(sa.sa_sem);
+    vfs_close(sa.sa_vnode);
+    kfree(sa.sa_kbuf);
+    return -ENOMEM;
+  }
+  pid = new_proc->pid;
+
+  result = thread_fork(new_proc->p_name, new_proc, spawn_start, &sa, 0);
+  if(result){
+    proc_destroy(new_proc);
+    /* reap it right away */
+    proc_wait_child(pid, 0, &status);
+    vfs_close(sa.sa_vnode);
+  }
+  else{
+    P(sa.sa_sem);
+    result = sa.sa_result;
+    if(result)
+      proc_wait_child(pid, 0, &status);
+  }
+  sem_destroy(sa.sa_sem);
+  kfree(sa.sa_kbuf);
+  return result ? -result : pid;
+}
 #endif
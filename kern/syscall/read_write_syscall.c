@@ -1,83 +1,236 @@
 #include "read_write_syscalls.h"
+#include <kern/fcntl.h>
+#include <kern/seek.h>
+#include <kern/stat.h>
+#include <synch.h>
+#include <spl.h>
+#include <cpu.h>
+#include <platform/maxcpus.h>
 
 struct openfile{
   struct vnode* v;
   int ref_cnt;
-  int offset;
+  off_t offset;
   int mode;
+  struct lock* lock;   // held across read/write/lseek, so that each moves the offset atomically
+  struct spinlock ref_lock;   // protects ref_cnt
+  struct openfile* next;   // free list of the cache
 };
-struct spinlock open_file_lock = SPINLOCK_INITIALIZER;
 
-struct openfile sys_open_files[SYS_OPEN_FILE_MAX];
+/*
+ * Open files are allocated from small per-CPU caches of free entries,
+ * which keep their lock: an open takes an entry off the list of its
+ * CPU with interrupts off, and neither scans a system-wide table nor
+ * takes a global lock. Each open gets its own entry (and offset); the
+ * entry is shared only by the descriptors that fork copies.
+ */
+#define OF_CACHE_MAX 16
+
+struct of_cache{
+  struct openfile* head;
+  unsigned count;
+};
+static struct of_cache of_caches[MAXCPUS];
+
+/* returns a free open file (from the cache of this CPU if possible), NULL if out of memory */
+static struct openfile* openfile_alloc(void){
+  struct of_cache* c;
+  struct openfile* of;
+  int spl;
+
+  spl = splhigh();
+  c = &of_caches[curcpu->c_number];
+  of = c->head;
+  if(of != NULL){
+    c->head = of->next;
+    c->count--;
+  }
+  splx(spl);
+  if(of != NULL)
+    return of;
+
+  of = kmalloc(sizeof(struct openfile));
+  if(of == NULL)
+    return NULL;
+  of->lock = lock_create("openfile");
+  if(of->lock == NULL){
+    kfree(of);
+    return NULL;
+  }
+  spinlock_init(&of->ref_lock);
+  return of;
+}
+
+/* give back an unused open file to the cache of this CPU, or free it if the cache is full */
+static void openfile_free(struct openfile* of){
+  struct of_cache* c;
+  int spl;
+
+  of->v = NULL;
+  spl = splhigh();
+  c = &of_caches[curcpu->c_number];
+  if(c->count < OF_CACHE_MAX){
+    of->next = c->head;
+    c->head = of;
+    c->count++;
+    of = NULL;
+  }
+  splx(spl);
+  if(of != NULL){
+    lock_destroy(of->lock);
+    spinlock_cleanup(&of->ref_lock);
+    kfree(of);
+  }
+}
+
+/* add a reference to an open file (a descriptor copied by fork) */
+void openfile_incref(struct openfile* of){
+  spinlock_acquire(&of->ref_lock);
+  of->ref_cnt++;
+  spinlock_release(&of->ref_lock);
+}
+
+/* drop a reference to an open file, closing the vnode with the last one */
+void openfile_release(struct openfile* of){
+  int refs;
+
+  spinlock_acquire(&of->ref_lock);
+  refs = --of->ref_cnt;
+  spinlock_release(&of->ref_lock);
+  if(refs > 0)
+    return;
+  vfs_close(of->v);
+  openfile_free(of);
+}
 
 int sys_open(char* filename, int flags){
   struct vnode* v;
-  int i, sfd=-1, fd=-1;
-  
+  struct openfile* of;
+  int fd;
+
   if(vfs_open(filename, flags, 0777, &v)){
     return -ENOENT;
   }
-  // insert into sys_open_file table
-  spinlock_acquire(&open_file_lock);
-  for(i=0; i < SYS_OPEN_FILE_MAX; i++){
-    if(sys_open_files[i].v == v && sys_open_files[i].mode == flags){
-      sfd = i;
-      break;
-    }
-  }
-  for(i=0; i < SYS_OPEN_FILE_MAX && sfd < 0; i++){
-    if(sys_open_files[i].v == NULL){
-      sfd = i;
-      sys_open_files[i].v = v;
-      sys_open_files[i].ref_cnt = 1;
-      sys_open_files[i].offset = 0;
-      sys_open_files[i].mode = flags;
-      break;
-    }
+  of = openfile_alloc();
+  if(of == NULL){
+    vfs_close(v);
+    return -ENOMEM;
   }
-  spinlock_release(&open_file_lock);
-  // check if limit reached
-  if(i >= SYS_OPEN_FILE_MAX)
-    return -ENFILE;
-  
+  of->v = v;
+  of->ref_cnt = 1;
+  of->offset = 0;
+  of->mode = flags;
+
   // insert into per process file table
-  fd = proc_add_file(&sys_open_files[sfd]);
-  if(fd < 0){
-    // errors so remove from sys table
-    spinlock_acquire(&open_file_lock);
-    sys_open_files[i].v = NULL;
-    sys_open_files[i].ref_cnt = 0;
-    spinlock_release(&open_file_lock);
-  }
+  fd = proc_add_file(of);
+  if(fd < 0)
+    openfile_release(of);
   return fd;
 }
 
 int sys_close(int fd){
   struct openfile* proc_file;
-  int sfd=-1;
+
   if(fd < 0 || fd >= OPEN_MAX)
     return -ENOENT;
   proc_file = proc_rem_file(fd);
   if(proc_file == NULL)
     return -ENOENT;
+  openfile_release(proc_file);
+  return 0;
+}
 
-  sfd = (int) (proc_file - sys_open_files);
-  if(sfd < 0 || sfd >= SYS_OPEN_FILE_MAX)
-    return -ENOENT;
+/* returns the open file fd of the current process if it was opened for rw (UIO_READ or UIO_WRITE), NULL if not */
+static struct openfile* file_get(int fd, enum uio_rw rw){
+  struct openfile* open_file;
 
-  spinlock_acquire(&open_file_lock);
-  sys_open_files[sfd].ref_cnt--;
-  if(sys_open_files[sfd].ref_cnt <= 0)
-    sys_open_files[sfd].v = NULL;
-  spinlock_release(&open_file_lock);
+  if(fd < 0 || fd >= OPEN_MAX)
+    return NULL;
+  open_file = curproc->open_files[fd];
+  if(open_file == NULL)
+    return NULL;
+  if(rw == UIO_READ && (open_file->mode & O_ACCMODE) == O_WRONLY)
+    return NULL;
+  if(rw == UIO_WRITE && (open_file->mode & O_ACCMODE) == O_RDONLY)
+    return NULL;
+  return open_file;
+}
 
-  return 0;
+/* one VOP_READ/VOP_WRITE of len bytes between the user iovecs and the file at *offset, advancing it; the bytes moved go in *moved */
+static int file_uio(struct openfile* open_file, struct iovec* iov, int iovcnt, int len, off_t* offset, enum uio_rw rw, int* moved){
+  struct uio u;
+  int result;
+
+  u.uio_iov = iov;
+  u.uio_iovcnt = iovcnt;
+  u.uio_resid = len;
+  u.uio_offset = *offset;
+  u.uio_segflg = UIO_USERSPACE;
+  u.uio_rw = rw;
+  u.uio_space = proc_getas();
+
+  result = rw == UIO_READ ? VOP_READ(open_file->v, &u) : VOP_WRITE(open_file->v, &u);
+  *offset = u.uio_offset;
+  *moved = len - u.uio_resid;
+  return result;
+}
+
+/*
+ * Move size bytes between the user buffer and the file at *offset,
+ * advancing *offset. The data goes straight to/from the user buffer,
+ * a chunk at a time so that a huge transfer does not keep the vnode
+ * busy. Returns the bytes moved (short at end of file), or -errno if
+ * nothing could be moved.
+ */
+static int file_io(struct openfile* open_file, char* buffer, int size, off_t* offset, enum uio_rw rw){
+  struct iovec iov;
+  int i, chunk, moved, result;
+
+  for(i = 0; i < size; i += chunk){
+    chunk = size - i < IO_CHUNK ? size - i : IO_CHUNK;
+    iov.iov_ubase = (userptr_t)(buffer + i);
+    iov.iov_len = chunk;
+    result = file_uio(open_file, &iov, 1, chunk, offset, rw, &moved);
+    if(result){
+      // report what was moved before the error, if anything
+      i += moved;
+      return i > 0 ? i : -result;
+    }
+    if(moved < chunk){
+      // end of file
+      i += moved;
+      break;
+    }
+  }
+  return i;
+}
+
+/*
+ * Console input: a line (or the characters typed so far) is read by
+ * the console driver and copied out at once.
+ */
+static int con_read(char* buffer, int size){
+  char* kbuf;
+  size_t len;
+  int result;
+
+  if(size <= 0)
+    return 0;
+  len = size < CON_CHUNK ? size : CON_CHUNK;
+  kbuf = kmalloc(len);
+  if(kbuf == NULL)
+    return -ENOMEM;
+  len = getchars(kbuf, len);
+  result = copyout(kbuf, (userptr_t)buffer, len);
+  kfree(kbuf);
+  if(result)
+    return -result;
+  return len;
 }
 
 int sys_read(int file, void* buffer, int size){
   char* read_buffer = (char*)buffer;
-  int i = file, result;
-  char c;
+  int i = file;
 
   if(buffer == NULL)
     return 0;
@@ -85,45 +238,45 @@ int sys_read(int file, void* buffer, int size){
     return -EBADF;
   
   if(file == STDIN_FILENO){
-    for(i = 0; i < size; i++){
-      c = getch();
-      if(c == 3){
-	read_buffer[i] = '\0';
-	break;
-      }
-      read_buffer[i] = c;
-    }
+    i = con_read(read_buffer, size);
   }else{
-    // get openfile struct
     struct openfile* open_file;
-    char *buff;
-    struct iovec iov;
-    struct uio ku;
-    int transferred = 0;
-    
-    open_file = curproc->open_files[file];
+
     // check if file is open for reading
-    if(open_file == NULL || open_file->mode & 1) 
+    open_file = file_get(file, UIO_READ);
+    if(open_file == NULL)
       return -EBADF;
-    // alloc kernel buffer
-    buff = kmalloc(size);
-    if(buff == NULL)
-      return -ENOMEM;
-    // read into kernel buffer
-    uio_kinit(&iov, &ku, buff, size, open_file->offset, UIO_READ);
-    result = VOP_READ(open_file->v, &ku);
+    lock_acquire(open_file->lock);
+    i = file_io(open_file, read_buffer, size, &open_file->offset, UIO_READ);
+    lock_release(open_file->lock);
+  }
+  return i;
+}
+
+/*
+ * Console output: the user buffer is copied in a chunk at a time and
+ * queued on the console ring as a whole, the write-done interrupts
+ * take care of the rest.
+ */
+static int con_write(char* buffer, int size){
+  char* kbuf;
+  int i, chunk, result;
+
+  if(size <= 0)
+    return 0;
+  kbuf = kmalloc(size < CON_CHUNK ? size : CON_CHUNK);
+  if(kbuf == NULL)
+    return -ENOMEM;
+  for(i = 0; i < size; i += chunk){
+    chunk = size - i < CON_CHUNK ? size - i : CON_CHUNK;
+    result = copyin((const_userptr_t)(buffer + i), kbuf, chunk);
     if(result){
-      kfree(buff);
-      return -EIO;
-    }
-    transferred = size - ku.uio_resid;
-    // move into user space
-    if(copyout(buff, buffer, transferred)){
-      return -EIO;
+      kfree(kbuf);
+      return i > 0 ? i : -result;
     }
-    i = transferred;
-    kfree(buff);
+    putchars(kbuf, chunk);
   }
+  kfree(kbuf);
   return i;
 }
 
@@ -137,35 +290,172 @@ int sys_write(int file, void* buffer, int size){
     return -EBADF;
 
   if(file == STDOUT_FILENO || file == STDERR_FILENO){
-     for(nw = 0; nw < size; nw++){
-       putch(write_buffer[nw]); 
-     }
+    nw = con_write(write_buffer, size);
   }else{
     struct openfile *open_file;
-    struct uio u;
-    struct iovec iov;
-    int result;
 
-    // get openfile
-    open_file = curproc->open_files[file];
     // check file exists and opened for writing
-    if(open_file == NULL || (open_file->mode & 3) == 0)
+    open_file = file_get(file, UIO_WRITE);
+    if(open_file == NULL)
       return -EBADF;
-    
-    iov.iov_ubase = (userptr_t)buffer;
-    iov.iov_len = size;       // length of the memory space
-    u.uio_iov = &iov;
-    u.uio_iovcnt = 1;
-    u.uio_resid = size;          // amount to read from the file
-    u.uio_offset = open_file->offset;
-    u.uio_segflg = UIO_USERSPACE;
-    u.uio_rw = UIO_WRITE;
-    u.uio_space = proc_getas();
-
-    result = VOP_WRITE(open_file->v, &u);
-    if(result)
-      return -EIO;
-    nw = size - u.uio_resid;
+    lock_acquire(open_file->lock);
+    nw = file_io(open_file, write_buffer, size, &open_file->offset, UIO_WRITE);
+    lock_release(open_file->lock);
   }
   return nw;
 }
+
+/*
+ * readv/writev: the user iovecs are copied in and passed down to the
+ * file system in a single VOP_READ/VOP_WRITE, so a record made of
+ * several buffers is written with one call and one offset update.
+ */
+static int file_iov(int file, userptr_t uiov, int iovcnt, enum uio_rw rw){
+  struct openfile* open_file;
+  struct iovec* iov;
+  size_t len;
+  int i, moved, result;
+
+  if(iovcnt < 0 || iovcnt > IOV_MAX)
+    return -EINVAL;
+  if(iovcnt == 0)
+    return 0;
+  if(file < 0 || file >= OPEN_MAX)
+    return -EBADF;
+  iov = kmalloc(iovcnt * sizeof(struct iovec));
+  if(iov == NULL)
+    return -ENOMEM;
+  result = copyin((const_userptr_t)uiov, iov, iovcnt * sizeof(struct iovec));
+  if(result){
+    kfree(iov);
+    return -result;
+  }
+  // the total must fit in the return value
+  for(i = 0, len = 0; i < iovcnt; i++){
+    if(iov[i].iov_len > IOV_LEN_MAX - len){
+      kfree(iov);
+      return -EINVAL;
+    }
+    len += iov[i].iov_len;
+  }
+
+  if(file <= STDERR_FILENO){
+    // the console has no vnode: one buffer at a time
+    for(i = 0, moved = 0; i < iovcnt; i++){
+      result = rw == UIO_READ ? sys_read(file, iov[i].iov_ubase, iov[i].iov_len) :
+        sys_write(file, iov[i].iov_ubase, iov[i].iov_len);
+      if(result < 0){
+        moved = moved > 0 ? moved : result;
+        break;
+      }
+      moved += result;
+      if(result < (int)iov[i].iov_len)
+        break;
+    }
+    kfree(iov);
+    return moved;
+  }
+
+  open_file = file_get(file, rw);
+  if(open_file == NULL){
+    kfree(iov);
+    return -EBADF;
+  }
+  lock_acquire(open_file->lock);
+  result = file_uio(open_file, iov, iovcnt, len, &open_file->offset, rw, &moved);
+  lock_release(open_file->lock);
+  kfree(iov);
+  if(result && moved == 0)
+    return -result;
+  return moved;
+}
+
+int sys_readv(int file, userptr_t iov, int iovcnt){
+  return file_iov(file, iov, iovcnt, UIO_READ);
+}
+
+int sys_writev(int file, userptr_t iov, int iovcnt){
+  return file_iov(file, iov, iovcnt, UIO_WRITE);
+}
+
+/* read/write at pos without using or moving the offset of the file (no lock: parallel callers do not wait for each other) */
+static int file_pio(int file, void* buffer, int size, off_t pos, enum uio_rw rw){
+  struct openfile* open_file;
+
+  open_file = file_get(file, rw);
+  // the console descriptors have no open file
+  if(open_file == NULL)
+    return file >= 0 && file <= STDERR_FILENO ? -ESPIPE : -EBADF;
+  if(!VOP_ISSEEKABLE(open_file->v))
+    return -ESPIPE;
+  if(pos < 0)
+    return -EINVAL;
+  return file_io(open_file, buffer, size, &pos, rw);
+}
+
+int sys_pread(int file, void* buffer, int size, off_t pos){
+  return file_pio(file, buffer, size, pos, UIO_READ);
+}
+
+int sys_pwrite(int file, void* buffer, int size, off_t pos){
+  return file_pio(file, buffer, size, pos, UIO_WRITE);
+}
+
+off_t sys_lseek(int file, off_t pos, int whence){
+  struct openfile* open_file;
+  struct stat st;
+  off_t base, newpos;
+  int result;
+
+  if(file < 0 || file >= OPEN_MAX)
+    return -EBADF;
+  open_file = curproc->open_files[file];
+  if(open_file == NULL)
+    return file <= STDERR_FILENO ? -ESPIPE : -EBADF;
+  // ask the file: a console opened again is not seekable, whatever its descriptor
+  if(!VOP_ISSEEKABLE(open_file->v))
+    return -ESPIPE;
+
+  lock_acquire(open_file->lock);
+  switch(whence){
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = open_file->offset;
+    break;
+  case SEEK_END:
+    result = VOP_STAT(open_file->v, &st);
+    if(result){
+      lock_release(open_file->lock);
+      return -result;
+    }
+    base = st.st_size;
+    break;
+  default:
+    lock_release(open_file->lock);
+    return -EINVAL;
+  }
+  // base is never negative, so a sum that overflows comes out negative (computed unsigned, which wraps)
+  newpos = (off_t)((uint64_t)base + (uint64_t)pos);
+  if(newpos < 0){
+    lock_release(open_file->lock);
+    return -EINVAL;
+  }
+  open_file->offset = newpos;
+  lock_release(open_file->lock);
+  return newpos;
+}
+
+/* returns the vnode of fd and its open mode (in *mode), NULL if fd is not open */
+struct vnode *file_get_vnode(int fd, int *mode){
+  struct openfile *open_file;
+
+  if(fd < 0 || fd >= OPEN_MAX)
+    return NULL;
+  open_file = curproc->open_files[fd];
+  if(open_file == NULL || open_file->v == NULL)
+    return NULL;
+  *mode = open_file->mode;
+  return open_file->v;
+}
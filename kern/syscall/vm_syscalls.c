@@ -0,0 +1,224 @@
+#include <vm_syscalls.h>
+#include <segments.h>
+#include <vm_tlb.h>
+#include <pt.h>
+#include <vnode.h>
+#include <kern/fcntl.h>
+#include <kern/mman.h>
+#include <kern/stat.h>
+#include <read_write_syscalls.h>
+#include <copyinout.h>
+#include <vmstats.h>
+#include <opt-proc_manage.h>
+
+/*
+ * Move the end of the heap by amount bytes and return the old end.
+ * The heap is a zero-fill region: growing it only changes its size,
+ * pages get a frame on the first fault. Shrinking it releases the
+ * frames and swap slots of the pages that were actually touched.
+ */
+int sys_sbrk(intptr_t amount)
+{
+  struct addrspace *as = proc_getas();
+  struct segment *heap;
+  vaddr_t oldbrk, newbrk, oldend, newend, limit;
+
+  if (as == NULL)
+    return -EFAULT;
+  heap = seg_heap(as);
+  if (heap == NULL)
+    return -ENOMEM;
+
+  oldbrk = as->as_heapbrk;
+  if (amount < 0 && (vaddr_t)-amount > oldbrk - heap->s_vbase)
+    return -EINVAL;
+  newbrk = oldbrk + amount;
+  if (amount > 0 && newbrk < oldbrk)
+    return -ENOMEM;
+
+  /* leave a guard page below the next region (or below the lowest stack address) */
+  newend = ROUNDUP(newbrk, PAGE_SIZE);
+  limit = SEG_STACK_LIMIT;
+  if (heap + 1 < as->as_segs + as->as_nsegs && (heap + 1)->s_vbase < limit)
+    limit = (heap + 1)->s_vbase;
+  if (newend + PAGE_SIZE > limit)
+    return -ENOMEM;
+
+  oldend = SEG_END(heap);
+  if (newend < oldend) {
+    if (heap->s_touchhi > newend) {
+      pt_delete_range(newend > heap->s_touchlo ? newend : heap->s_touchlo, heap->s_touchhi, curproc->pid);
+      heap->s_touchhi = newend;
+      if (heap->s_touchlo >= heap->s_touchhi)
+        heap->s_touchlo = heap->s_touchhi = 0;
+    }
+    /* also drops the read-only mappings of the zero page */
+    tlb_invalidate_range(newend, oldend);
+  }
+  heap->s_npages = (newend - heap->s_vbase) / PAGE_SIZE;
+  as->as_heapbrk = newbrk;
+
+  /* user addresses are below 0x80000000, so they never look like an error */
+  return (int)oldbrk;
+}
+
+/*
+ * Copy up to ncounts VM counters (VMS_* order) of process pid, or of
+ * the whole system if pid is 0, to the user buffer counts. Returns the
+ * number of counters copied.
+ */
+int sys_vmstat(pid_t pid, userptr_t counts, size_t ncounts)
+{
+  unsigned int c[VMS_NSTATS];
+  int result;
+
+  if (pid == 0)
+  {
+    vms_get(c);
+  }
+  else
+  {
+#if OPT_PROC_MANAGE
+    result = proc_vmstats(pid, c, NULL, 0);
+#else
+    result = ESRCH;
+#endif
+    if (result)
+      return -result;
+  }
+  if (ncounts > VMS_NSTATS)
+    ncounts = VMS_NSTATS;
+  result = copyout(c, counts, ncounts * sizeof(unsigned int));
+  if (result)
+    return -result;
+  return ncounts;
+}
+
+#if OPT_READ_WRITE
+/*
+ * Map len bytes of the file open as fd, starting at offset, in a new
+ * region. Pages are read from the file on the first fault (with some
+ * read-ahead) and are private to the process: writes to a PROT_WRITE
+ * mapping never reach the file, so shared mappings must be read-only.
+ * addr is only a hint and is ignored.
+ */
+int sys_mmap(vaddr_t addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+  struct addrspace *as = proc_getas();
+  struct segment seg;
+  struct vnode *v;
+  struct stat st;
+  size_t npages;
+  int mode, result;
+
+  (void)addr;
+  if (as == NULL)
+    return -EFAULT;
+  if (len == 0 || offset < 0 || (offset & ~(off_t)PAGE_FRAME) != 0)
+    return -EINVAL;
+  if ((flags & (MAP_SHARED | MAP_PRIVATE)) == 0 || (flags & (MAP_SHARED | MAP_PRIVATE)) == (MAP_SHARED | MAP_PRIVATE) ||
+      (flags & ~(MAP_SHARED | MAP_PRIVATE)) != 0 || (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) != 0)
+    return -EINVAL;
+  if ((flags & MAP_SHARED) && (prot & PROT_WRITE))
+    return -ENOTSUP;
+
+  v = file_get_vnode(fd, &mode);
+  if (v == NULL)
+    return -EBADF;
+  if ((mode & O_ACCMODE) == O_WRONLY)
+    return -EACCES;
+  /* only files that can be paged through VOP_READ (not devices) */
+  result = VOP_MMAP(v);
+  if (result)
+    return -result;
+  result = VOP_STAT(v, &st);
+  if (result)
+    return -result;
+
+  /* no mapping is bigger than user space (and the round up below would wrap) */
+  if (len > USERSTACK)
+    return -ENOMEM;
+  npages = DIVROUNDUP(len, PAGE_SIZE);
+  seg.s_vbase = seg_find_free(as, npages);
+  if (seg.s_vbase == 0)
+    return -ENOMEM;
+  seg.s_npages = npages;
+  seg.s_elfbase = seg.s_vbase;
+  seg.s_offset = offset;
+  /* past the end of the file the mapping reads as zeros */
+  if (offset >= st.st_size)
+    seg.s_filesize = 0;
+  else if (st.st_size - offset < (off_t)len)
+    seg.s_filesize = st.st_size - offset;
+  else
+    seg.s_filesize = len;
+  seg.s_flags = 0;
+  if (prot & PROT_READ)
+    seg.s_flags |= SEG_R;
+  if (prot & PROT_WRITE)
+    seg.s_flags |= SEG_W;
+  if (prot & PROT_EXEC)
+    seg.s_flags |= SEG_X;
+  seg.s_backing = SEG_BACKING_FILE;
+  seg.s_vnode = v;
+  seg.s_touchlo = seg.s_touchhi = 0;
+
+  VOP_INCREF(v);
+  result = seg_add(as, &seg);
+  if (result) {
+    VOP_DECREF(v);
+    return -result;
+  }
+  return (int)seg.s_vbase;
+}
+
+/*
+ * Remove the mappings in [addr, addr + len). Mappings partially in the
+ * range are cut (or split in two); other regions are left untouched.
+ */
+int sys_munmap(vaddr_t addr, size_t len)
+{
+  struct addrspace *as = proc_getas();
+  struct segment *seg;
+  vaddr_t end, lo, hi;
+  unsigned i;
+  int result;
+
+  if (as == NULL)
+    return -EFAULT;
+  if ((addr & PAGE_FRAME) != addr || len == 0)
+    return -EINVAL;
+  end = addr + ROUNDUP(len, PAGE_SIZE);
+  if (end <= addr || end > USERSTACK)
+    return -EINVAL;
+
+  for (i = 0; i < as->as_nsegs; ) {
+    seg = &as->as_segs[i];
+    if (seg->s_backing != SEG_BACKING_FILE || SEG_END(seg) <= addr || seg->s_vbase >= end) {
+      i++;
+      continue;
+    }
+    /* cut the part outside the range away, so that region i is all in it */
+    if (seg->s_vbase < addr) {
+      result = seg_split(as, i, addr);
+      if (result)
+        return -result;
+      i++;
+      continue;
+    }
+    if (SEG_END(seg) > end) {
+      result = seg_split(as, i, end);
+      if (result)
+        return -result;
+      seg = &as->as_segs[i];
+    }
+    lo = seg->s_vbase;
+    hi = SEG_END(seg);
+    if (seg->s_touchlo < seg->s_touchhi)
+      pt_delete_range(seg->s_touchlo, seg->s_touchhi, curproc->pid);
+    tlb_invalidate_range(lo, hi);
+    seg_remove(as, i);
+  }
+  return 0;
+}
+#endif
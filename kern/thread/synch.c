@@ -120,6 +120,22 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+bool
+sem_tryP(struct semaphore *sem)
+{
+	bool ret = false;
+
+        KASSERT(sem != NULL);
+
+	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_count > 0) {
+		sem->sem_count--;
+		ret = true;
+	}
+	spinlock_release(&sem->sem_lock);
+	return ret;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -40,6 +40,7 @@
 #include <cpu.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <membar.h>
 #include <wchan.h>
 #include <thread.h>
 #include <threadlist.h>
@@ -108,6 +109,66 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Get a kernel stack for a new thread, preferably one released by a
+ * thread that ran on this cpu. Pooled stacks already carry the magic
+ * numbers, which were checked when the stack was released.
+ */
+static
+int
+thread_stack_get(struct thread *thread)
+{
+	int spl;
+
+	KASSERT(thread->t_stack == NULL);
+
+	spl = splhigh();
+	if (curcpu->c_nstackpool > 0) {
+		curcpu->c_nstackpool--;
+		thread->t_stack = curcpu->c_stackpool[curcpu->c_nstackpool];
+	}
+	splx(spl);
+
+	if (thread->t_stack == NULL) {
+		thread->t_stack = kmalloc(STACK_SIZE);
+		if (thread->t_stack == NULL) {
+			return ENOMEM;
+		}
+		thread_checkstack_init(thread);
+	}
+	return 0;
+}
+
+/*
+ * Release the kernel stack of a dead thread. The magic numbers are
+ * checked here, so an overflow is caught before the stack is reused;
+ * the stack is kept in this cpu's pool unless the pool is full.
+ */
+static
+void
+thread_stack_put(struct thread *thread)
+{
+	int spl;
+
+	if (thread->t_stack == NULL) {
+		return;
+	}
+	thread_checkstack(thread);
+
+	spl = splhigh();
+	if (curcpu->c_nstackpool < CPU_STACKPOOL_SIZE) {
+		curcpu->c_stackpool[curcpu->c_nstackpool] = thread->t_stack;
+		curcpu->c_nstackpool++;
+		thread->t_stack = NULL;
+	}
+	splx(spl);
+
+	if (thread->t_stack != NULL) {
+		kfree(thread->t_stack);
+		thread->t_stack = NULL;
+	}
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -147,6 +208,9 @@ thread_create(const char *name)
 	thread->t_curspl = IPL_HIGH;
 	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
 
+	/* Public fields */
+	thread->t_ptbusy = 0;
+
 	/* If you add to struct thread, be sure to initialize here */
 
 	return thread;
@@ -179,6 +243,7 @@ cpu_create(unsigned hardware_number)
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_nstackpool = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
@@ -186,6 +251,9 @@ cpu_create(unsigned hardware_number)
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_shootdown_all = false;
+	c->c_shootdown_seq = 0;
+	c->c_shootdown_done = 0;
 	spinlock_init(&c->c_ipi_lock);
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
@@ -274,9 +342,7 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
-	if (thread->t_stack != NULL) {
-		kfree(thread->t_stack);
-	}
+	thread_stack_put(thread);
 	threadlistnode_cleanup(&thread->t_listnode);
 	thread_machdep_cleanup(&thread->t_machdep);
 
@@ -506,12 +572,11 @@ thread_fork(const char *name,
 	}
 
 	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
+	result = thread_stack_get(newthread);
+	if (result) {
 		thread_destroy(newthread);
-		return ENOMEM;
+		return result;
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -1136,32 +1201,67 @@ ipi_broadcast(int code)
 void
 ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 {
-	unsigned n;
+	(void)ipi_tlbshootdown_batch(target, mapping, 1);
+}
+
+/*
+ * Queue N TLB shootdowns for the specified CPU (or a flush of its
+ * whole TLB, if MAPPINGS is NULL) and interrupt it. Returns a ticket
+ * for ipi_tlbshootdown_wait.
+ */
+unsigned
+ipi_tlbshootdown_batch(struct cpu *target,
+		       const struct tlbshootdown *mappings, unsigned n)
+{
+	unsigned i, ticket;
 
 	spinlock_acquire(&target->c_ipi_lock);
 
-	n = target->c_numshootdown;
-	if (n == TLBSHOOTDOWN_MAX) {
+	if (mappings == NULL || target->c_shootdown_all ||
+	    target->c_numshootdown + n > TLBSHOOTDOWN_MAX) {
 		/*
-		 * If you have problems with this panic going off,
-		 * consider: (1) increasing the maximum, (2) putting
-		 * logic here to sleep until space appears (may
-		 * interact awkwardly with VM system locking), (3)
-		 * putting logic here to coalesce requests together,
-		 * and/or (4) improving VM system state tracking to
-		 * reduce the number of unnecessary shootdowns.
+		 * Too many to remember: coalesce everything queued
+		 * into a flush of the whole TLB.
 		 */
-		panic("ipi_tlbshootdown: Too many shootdowns queued\n");
+		target->c_shootdown_all = true;
+		target->c_numshootdown = 0;
 	}
 	else {
-		target->c_shootdown[n] = *mapping;
-		target->c_numshootdown = n+1;
+		for (i=0; i<n; i++) {
+			target->c_shootdown[target->c_numshootdown++] =
+				mappings[i];
+		}
 	}
+	ticket = ++target->c_shootdown_seq;
 
-	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
+	/*
+	 * If a shootdown IPI is already pending, the target has not
+	 * looked at its queue yet and will pick these up with the
+	 * others.
+	 */
+	if ((target->c_ipi_pending & ((uint32_t)1 << IPI_TLBSHOOTDOWN)) == 0) {
+		target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
+		mainbus_send_ipi(target);
+	}
 
 	spinlock_release(&target->c_ipi_lock);
+	return ticket;
+}
+
+/*
+ * Wait until the specified CPU has carried out the shootdowns queued
+ * up to TICKET. Interrupts must be enabled: the target might be
+ * waiting for us at the same time.
+ */
+void
+ipi_tlbshootdown_wait(struct cpu *target, unsigned ticket)
+{
+	KASSERT(curthread->t_iplhigh_count == 0);
+	KASSERT(curcpu->c_spinlocks == 0);
+
+	while ((int)(ticket - target->c_shootdown_done) > 0) {
+		membar_any_any();
+	}
 }
 
 /*
@@ -1205,10 +1305,18 @@ interprocessor_interrupt(void)
 		 * need to release the ipi lock while calling
 		 * vm_tlbshootdown.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		if (curcpu->c_shootdown_all) {
+			vm_tlbshootdown_all();
+			curcpu->c_shootdown_all = false;
+		}
+		else {
+			for (i=0; i<curcpu->c_numshootdown; i++) {
+				vm_tlbshootdown(&curcpu->c_shootdown[i]);
+			}
 		}
 		curcpu->c_numshootdown = 0;
+		membar_any_any();
+		curcpu->c_shootdown_done = curcpu->c_shootdown_seq;
 	}
 
 	curcpu->c_ipi_pending = 0;
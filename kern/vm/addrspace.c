@@ -36,6 +36,8 @@
 #include <vm.h>
 #include <vm_tlb.h>
 #include <vmstats.h>
+#include <vmalloc.h>
+#include <segments.h>
 
 static void
 vm_can_sleep(void)
@@ -59,17 +61,14 @@ as_create(void)
 		return NULL;
 	}
 
+#if OPT_PAGING
+	seg_init(as);
+	as->as_heapbrk = 0;
+#else
 	as->as_vbase1 = 0;
 	as->as_npages1 = 0;
 	as->as_vbase2 = 0;
 	as->as_npages2 = 0;
-#if OPT_PAGING
-	as->as_offset1 = 0;
-	as->as_filesize1 = 0;
-	as->as_offset2 = 0;
-	as->as_filesize2 = 0;
-	as->as_flags = 0;
-#else
 	as->as_pbase1 = 0;
 	as->as_pbase2 = 0;
 	as->as_stackpbase = 0;
@@ -80,7 +79,9 @@ as_create(void)
 void as_destroy(struct addrspace *as)
 {
 	vm_can_sleep();
-#if !OPT_PAGING
+#if OPT_PAGING
+	seg_destroy(as);
+#else
 	free_kpages(PADDR_TO_KVADDR(as->as_pbase1));
 	free_kpages(PADDR_TO_KVADDR(as->as_pbase2));
 	free_kpages(PADDR_TO_KVADDR(as->as_stackpbase));
@@ -90,27 +91,17 @@ void as_destroy(struct addrspace *as)
 
 void as_activate(void)
 {
-	int i, spl;
 	struct addrspace *as;
-	static pid_t last;
 
 	as = proc_getas();
 	if (as == NULL)
 	{
+		/* kernel thread: no user page can be refilled on this CPU */
+		tlb_activate(0);
 		return;
 	}
-	if(last == curproc->pid)
-		return;
-	last = curproc->pid;
-	/* Disable interrupts on this CPU while frobbing the TLB. */
-	spl = splhigh();
-
-	for (i = 0; i < NUM_TLB; i++)
-	{
-		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
-	}
-
-	splx(spl);
+	/* the TLB is kept if this CPU last ran the same process */
+	tlb_activate(curproc->pid);
 }
 
 void as_deactivate(void)
@@ -123,7 +114,7 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 					 int readable, int writeable, int executable,
 					 off_t offset, size_t filesize)
 {
-	size_t npages;
+	struct segment seg;
 	vaddr_t start_page = vaddr;
 
 	vm_can_sleep();
@@ -135,45 +126,23 @@ int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
 	/* ...and now the length. */
 	sz = (sz + PAGE_SIZE - 1) & PAGE_FRAME;
 
-	npages = sz / PAGE_SIZE;
-
-	if (as->as_vbase1 == 0)
-	{
-		as->as_vbase1 = start_page;
-		as->as_elfbase1 = vaddr;
-		as->as_npages1 = npages;
-		as->as_filesize1 = filesize;
-		as->as_offset1 = offset;
-		if (readable)
-			as->as_flags |= 1 << 2;
-		if (writeable)
-			as->as_flags |= 1 << 1;
-		if (executable)
-			as->as_flags |= 1;
-		return 0;
-	}
-
-	if (as->as_vbase2 == 0)
-	{
-		as->as_vbase2 = start_page;
-		as->as_elfbase2 = vaddr;
-		as->as_npages2 = npages;
-		as->as_filesize2 = filesize;
-		as->as_offset2 = offset;
-		if (readable)
-			as->as_flags |= 1 << 5;
-		if (writeable)
-			as->as_flags |= 1 << 4;
-		if (executable)
-			as->as_flags |= 1 << 3;
-		return 0;
-	}
-
-	/*
-	 * Support for more than two regions is not available.
-	 */
-	kprintf("Warning: too many regions\n");
-	return ENOSYS;
+	seg.s_vbase = start_page;
+	seg.s_npages = sz / PAGE_SIZE;
+	seg.s_elfbase = vaddr;
+	seg.s_offset = offset;
+	seg.s_filesize = filesize;
+	seg.s_flags = 0;
+	if (readable)
+		seg.s_flags |= SEG_R;
+	if (writeable)
+		seg.s_flags |= SEG_W;
+	if (executable)
+		seg.s_flags |= SEG_X;
+	seg.s_backing = SEG_BACKING_ELF;
+	seg.s_touchlo = seg.s_touchhi = 0;
+	seg.s_vnode = NULL;
+
+	return seg_add(as, &seg);
 }
 #else
 int as_define_region(struct addrspace *as, vaddr_t vaddr, size_t sz,
@@ -263,15 +232,63 @@ int as_prepare_load(struct addrspace *as)
 
 int as_complete_load(struct addrspace *as)
 {
+#if OPT_PAGING
+	struct segment seg;
+	int result;
+
+	vm_can_sleep();
+
+	/* the heap starts empty right after the highest ELF region */
+	seg.s_vbase = as->as_nsegs > 0 ? SEG_END(&as->as_segs[as->as_nsegs - 1]) : 0;
+	if (seg.s_vbase + PAGE_SIZE > SEG_STACK_LIMIT)
+	{
+		return ENOMEM;
+	}
+	seg.s_npages = 0;
+	seg.s_elfbase = seg.s_vbase;
+	seg.s_offset = 0;
+	seg.s_filesize = 0;
+	seg.s_flags = SEG_R | SEG_W | SEG_HEAP;
+	seg.s_backing = SEG_BACKING_ZERO;
+	seg.s_touchlo = seg.s_touchhi = 0;
+	seg.s_vnode = NULL;
+
+	result = seg_add(as, &seg);
+	if (result)
+	{
+		return result;
+	}
+	as->as_heapbrk = seg.s_vbase;
+#else
 	vm_can_sleep();
 	(void)as;
+#endif
 	return 0;
 }
 
 int as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 {
-	(void)as;
-#if !OPT_PAGING
+#if OPT_PAGING
+	struct segment seg;
+	int result;
+
+	/* only the top of the stack: the rest is added by the page faults below it */
+	seg.s_vbase = USERSTACK - SEG_STACK_INITPAGES * PAGE_SIZE;
+	seg.s_npages = SEG_STACK_INITPAGES;
+	seg.s_elfbase = seg.s_vbase;
+	seg.s_offset = 0;
+	seg.s_filesize = 0;
+	seg.s_flags = SEG_R | SEG_W | SEG_STACK;
+	seg.s_backing = SEG_BACKING_ZERO;
+	seg.s_touchlo = seg.s_touchhi = 0;
+	seg.s_vnode = NULL;
+
+	result = seg_add(as, &seg);
+	if (result)
+	{
+		return result;
+	}
+#else
 	KASSERT(as->as_stackpbase != 0);
 #endif
 	*stackptr = USERSTACK;
@@ -290,22 +307,19 @@ int as_copy(struct addrspace *old, struct addrspace **ret)
 		return ENOMEM;
 	}
 
+#if OPT_PAGING
+	if (seg_copy(old, new))
+	{
+		as_destroy(new);
+		return ENOMEM;
+	}
+	new->as_heapbrk = old->as_heapbrk;
+#else
 	new->as_vbase1 = old->as_vbase1;
 	new->as_npages1 = old->as_npages1;
 	new->as_vbase2 = old->as_vbase2;
 	new->as_npages2 = old->as_npages2;
 
-#if OPT_PAGING
-	new->as_offset2 = old->as_offset2;
-	new->as_filesize2 = old->as_filesize2;
-	new->as_elfbase2 = old->as_elfbase2;
-	new->as_elfbase1 = old->as_elfbase1;
-	new->as_offset1 = old->as_offset1;
-	new->as_filesize1 = old->as_filesize1;
-	new->as_flags = old->as_flags;
-#endif
-
-#if !OPT_PAGING
 	/* (Mis)use as_prepare_load to allocate some physical memory. */
 	if (as_prepare_load(new))
 	{
@@ -337,17 +351,24 @@ int as_copy(struct addrspace *old, struct addrspace **ret)
 #if OPT_PAGING
 int vm_fault(int faulttype, vaddr_t faultaddress)
 {
-	int status;
+	int status, path;
 	struct addrspace *as;
+	struct timespec start;
 
 	faultaddress &= PAGE_FRAME;
 
 	DEBUG(DB_VM, "tlb_manage[%d]: fault: 0x%x\n",faulttype, faultaddress);
 
+	if (IS_KSEG2(faultaddress))
+	{
+		/* mapped kernel memory, not part of any address space */
+		return vmalloc_fault(faultaddress);
+	}
+
 	switch (faulttype)
 	{
 	case VM_FAULT_READONLY:
-		return EFAULT;
+		/* a write to the zero page: pt_get_page checks it */
 	case VM_FAULT_READ:
 	case VM_FAULT_WRITE:
 		break;
@@ -376,14 +397,10 @@ int vm_fault(int faulttype, vaddr_t faultaddress)
 	}
 
 	/* Assert that the address space has been set up properly. */
-	KASSERT(as->as_vbase1 != 0);
-	KASSERT(as->as_npages1 != 0);
-	KASSERT(as->as_vbase2 != 0);
-	KASSERT(as->as_npages2 != 0);
-	KASSERT((as->as_vbase1 & PAGE_FRAME) == as->as_vbase1);
-	KASSERT((as->as_vbase2 & PAGE_FRAME) == as->as_vbase2);
-
-	status = pt_get_page(faultaddress);
+	KASSERT(as->as_nsegs != 0);
+
+	gettime(&start);
+	status = pt_get_page(faultaddress, faulttype, &path);
 	if (status != 0)
 	{
 		return EFAULT;
@@ -391,6 +408,7 @@ int vm_fault(int faulttype, vaddr_t faultaddress)
 
 	// update stats
 	vms_update(VMS_FAULTS);
+	vmt_record(path, curproc->pid, faultaddress, &start);
 	return 0;
 }
 
@@ -126,9 +126,12 @@ void vm_bootstrap(void)
 	allocated_size = kmalloc(nRamFrames * sizeof(unsigned int));
 	if (allocated_pages == NULL || allocated_size == NULL)
 	{
-		spinlock_release(&memSpinLock);
-		return;
+		/* nothing can run without the coremap */
+		panic("Error allocating coremap: out of memory.");
 	}
+	/* the kseg2 map is taken from boot memory, before the coremap is active */
+	vmalloc_bootstrap(nRamFrames);
+	pt_zero_bootstrap();
 	spinlock_acquire(&memSpinLock);
 
 	paddr_t start = ram_stealmem(1); /* get first free address */
@@ -159,6 +162,20 @@ alloc_kpages(unsigned npages)
 	paddr_t pa;
 
 	vm_can_sleep();
+	if (npages > 1 && active)
+	{
+		/*
+		 * Use contiguous frames only if they are already free;
+		 * otherwise map single frames in kseg2 instead of
+		 * stealing clusters from the page table.
+		 */
+		pa = pt_getfreekpages(npages);
+		if (pa == 0)
+		{
+			return vmalloc(npages);
+		}
+		return PADDR_TO_KVADDR(pa);
+	}
 	pa = getppages(npages);
 	if (pa == 0)
 	{
@@ -167,8 +184,22 @@ alloc_kpages(unsigned npages)
 	return PADDR_TO_KVADDR(pa);
 }
 
+/* number of free clusters at the end of kernel memory, 0 if they are fewer than 2 (called with memSpinLock held) */
+static int free_clusters(void){
+	int i, cnt;
+	i = (kernPages - 1);
+	while(i >= 0 && isPageFree(i)){
+		i--;
+	}
+	cnt = (kernPages - 1 ) - i;
+	if(cnt / CLUSTER_SIZE >= 2){
+		return cnt / CLUSTER_SIZE;
+	}
+	return 0;
+}
+
 int return_mem(uint32_t page){
-	int i, cnt = 0, n_alloc;
+	int i, cnt, n_alloc;
 	spinlock_acquire(&memSpinLock);
 	/* get number of contiguous pages allocated */
 	n_alloc = allocated_size[page];
@@ -178,19 +209,19 @@ int return_mem(uint32_t page){
 	{
 		pageSetFree(i);
 	}
-	i = (kernPages - 1);
-	while(i >= 0 && isPageFree(i)){
-		i--;
-	}
-	cnt = (kernPages - 1 ) - i;
-	if(cnt / CLUSTER_SIZE >= 2){
-		cnt /= CLUSTER_SIZE;
-		for(i=cnt*CLUSTER_SIZE; i> 0; i--){
-			kernPages--;
-			pageSetUsed(kernPages);
-		}
-	}else{
-		cnt = 0;
+	cnt = free_clusters();
+	spinlock_release(&memSpinLock);
+	return cnt;
+}
+
+int give_back_mem(void){
+	int i, cnt;
+	spinlock_acquire(&memSpinLock);
+	/* the frames may have been allocated again since return_mem */
+	cnt = free_clusters();
+	for(i=cnt*CLUSTER_SIZE; i> 0; i--){
+		kernPages--;
+		pageSetUsed(kernPages);
 	}
 	spinlock_release(&memSpinLock);
 	return cnt;
@@ -204,6 +235,11 @@ void free_kpages(vaddr_t addr)
 	{
 		return;
 	}
+	if (IS_KSEG2(addr))
+	{
+		vfree(addr);
+		return;
+	}
 
 	page = KVADDR_2_PADDR(addr) / PAGE_SIZE;
 	KASSERT(page < nRamFrames);
@@ -211,12 +247,6 @@ void free_kpages(vaddr_t addr)
 	pt_freekpages(page);
 }
 
-void vm_tlbshootdown(const struct tlbshootdown *ts)
-{
-	(void)ts;
-	panic("Tried to do tlb shootdown?!\n");
-}
-
 
 void memstats(void)
 {
@@ -0,0 +1,78 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <signal.h>
+#include <kern/wait.h>
+#include <spinlock.h>
+#include <current.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <limits.h>
+#include <pt.h>
+#include <swapfile.h>
+#include <vmstats.h>
+#include <proc_syscalls.h>
+#include <oom.h>
+
+/*
+ * OOM killer. When the swapfile is full and a fault finds only dirty
+ * pages in its cluster, the process holding the most pages (resident
+ * plus swapped out) is marked and its pages are released at once
+ * (pt_reap), even if it sleeps in the kernel (waitpid, console read).
+ * It exits the next time it goes back to user mode, without waiting
+ * for its parent. While a victim is being chosen and reaped, other
+ * faulting threads yield and retry.
+ */
+
+static struct spinlock oom_lock = SPINLOCK_INITIALIZER;
+static bool oom_busy = false;           /* a thread is choosing and reaping a victim */
+static unsigned int oom_pages[PID_MAX]; /* pages held by each pid (no allocation while memory is short) */
+
+int oom_kill(void)
+{
+    pid_t victim;
+    unsigned int reaped = 0;
+
+    spinlock_acquire(&oom_lock);
+    if (oom_busy)
+    {
+        spinlock_release(&oom_lock);
+        return 0;
+    }
+    oom_busy = true;
+    spinlock_release(&oom_lock);
+
+    bzero(oom_pages, sizeof(oom_pages));
+    pt_usage(oom_pages);
+    swap_usage(oom_pages);
+    victim = proc_oom_mark(oom_pages);
+    // the pages of the current process go when it exits, right after the fault fails
+    if (victim >= 0 && victim != curproc->pid)
+        reaped = pt_reap(victim);
+
+    spinlock_acquire(&oom_lock);
+    oom_busy = false;
+    spinlock_release(&oom_lock);
+
+    if (victim < 0)
+    {
+        // nobody else to kill
+        return ENOMEM;
+    }
+    vms_update(VMS_OOMKILLS);
+    kprintf("oom: out of memory and swap space, killing process %d (%u pages, %u released)\n",
+            victim, oom_pages[victim], reaped);
+    return victim == curproc->pid ? ENOMEM : 0;
+}
+
+bool oom_pending(void)
+{
+    return curproc != NULL && curproc->p_oomkilled;
+}
+
+void oom_exit(void)
+{
+    KASSERT(oom_pending());
+    // the address space is freed at exit, before the parent waits
+    proc_exit(_MKWAIT_SIG(SIGKILL));
+}
@@ -1,20 +1,104 @@
 #include <pt.h>
+#include <thread.h>
+#include <wchan.h>
 
 pt_entry *pagetable;
 static int nClusters = 0;
 static int start_cluster = 0;
 struct spinlock pt_lock = SPINLOCK_INITIALIZER;
+/*
+ * Page table geometry for the fast-path TLB refill (mips_utlb_refill in
+ * exception-mips1.S), which depends on this exact layout. pr_nclusters
+ * is 0 while the geometry changes, which sends every miss to vm_fault.
+ */
+struct pt_refill {
+    pt_entry *pr_table;         /* the page table */
+    uint32_t pr_nclusters;      /* number of clusters */
+    uint32_t pr_firstframe;     /* frame of the first entry */
+    uint32_t pr_clustershift;   /* log2(CLUSTER_SIZE) */
+    uint32_t pr_hash;           /* PT_HASH_* */
+};
+struct pt_refill pt_refill;
+
+int pt_cluster_size = 4;
+static unsigned int pt_hash_kind = PT_HASH_MOD;
+static const char *pt_hash_names[] = { "mod", "mult", "xor" };
+/*
+ * Thread moving the page table over a different range of frames
+ * (pt_getkpages/pt_freekpages). The table is inconsistent until the
+ * move is over, and the mover drops pt_lock to write pages to the
+ * swapfile: the other threads wait in pt_wait_resize.
+ */
+static struct thread *pt_resizer = NULL;
+/*
+ * A resize hands frames over and empties the table, so it cannot start
+ * while a frame is being filled (pt_busy > 0). It sleeps on
+ * pt_fill_wchan until the last fill ends; meanwhile (pt_draining > 0)
+ * no new fill starts, so the count drains even under a steady load of
+ * faults. A thread filling a frame itself never waits for that.
+ */
+static struct wchan *pt_fill_wchan = NULL;
+static unsigned int pt_draining = 0;
+/*
+ * Instrumentation of the clustered hash (protected by pt_lock).
+ * A conflict is the eviction of a page from a full cluster while
+ * other frames were free: a perfect hash would not have needed it.
+ */
+#define PT_CONFLICT_BUCKETS 16
+static unsigned int pt_used = 0;                            /* entries in use */
+static unsigned int pt_busy = 0;                            /* entries with PT_BUSY_BIT set */
+static unsigned int pt_evictions = 0;                       /* pages evicted by pt_get_page */
+static unsigned int pt_conflicts[PT_CONFLICT_BUCKETS];      /* conflicts, by log2 of the free frames at that time */
+/* frame filled with zeros, mapped read-only on reads of untouched stack/bss pages */
+static paddr_t zero_frame = 0;
+
+/* allocate the shared zero frame (called before the coremap is active) */
+void pt_zero_bootstrap(void)
+{
+    vaddr_t kpage = alloc_kpages(1);
+    if (kpage == 0)
+        panic("Error allocating zero page: out of memory.");
+    bzero((void *)kpage, PAGE_SIZE);
+    zero_frame = KVADDR_2_PADDR(kpage);
+}
+
+/* stop the fast refill from using the page table (called with pt_lock held) */
+static void pt_refill_disable(void)
+{
+    pt_refill.pr_nclusters = 0;
+    membar_store_store();
+}
+
+/* publish the current page table geometry to the fast refill (called with pt_lock held) */
+static void pt_refill_update(void)
+{
+    unsigned int shift;
+
+    pt_refill_disable();
+    for (shift = 0; (1 << shift) < CLUSTER_SIZE; shift++)
+        ;
+    KASSERT((1 << shift) == CLUSTER_SIZE);
+    pt_refill.pr_table = pagetable;
+    pt_refill.pr_firstframe = start_cluster * CLUSTER_SIZE;
+    pt_refill.pr_clustershift = shift;
+    pt_refill.pr_hash = pt_hash_kind;
+    membar_store_store();
+    pt_refill.pr_nclusters = nClusters;
+}
 
 /* bootstrap for the page table */
 void pt_bootstrap(int first_free)
 {
     int cnt = 1;
+    // the busy bit must not overlap the pid
+    COMPILE_ASSERT(((PID_MAX - 1) << 1) < PT_BUSY_BIT);
     first_free = (first_free + CLUSTER_SIZE) / CLUSTER_SIZE;
     nClusters = ((ram_getsize() / PAGE_SIZE) - (first_free * CLUSTER_SIZE)) / CLUSTER_SIZE;
     start_cluster = first_free;
     // allocating page table
     pagetable = kmalloc(nClusters * CLUSTER_SIZE * sizeof(pt_entry));
-    if (pagetable == NULL)
+    pt_fill_wchan = wchan_create("pt_fill");
+    if (pagetable == NULL || pt_fill_wchan == NULL)
         panic("Error allocating pagetable: out of memory.");
     // init page table
     for (cnt = 0; cnt < nClusters * CLUSTER_SIZE; cnt++)
@@ -22,60 +106,366 @@ void pt_bootstrap(int first_free)
         pagetable[cnt] = 0;
         pageSetUsed(cnt + start_cluster * CLUSTER_SIZE);
     }
+    pt_refill_update();
+}
+
+/* wait until no other thread is moving the page table (called with pt_lock held, returns with it held) */
+static void pt_wait_resize(void)
+{
+    while (pt_resizer != NULL && pt_resizer != curthread)
+    {
+        spinlock_release(&pt_lock);
+        thread_yield();
+        spinlock_acquire(&pt_lock);
+    }
+}
+
+/* wait until a frame may be taken to be filled: no resize, and none waiting for the fills (called with pt_lock held, returns with it held) */
+static void pt_wait_fill(void)
+{
+    pt_wait_resize();
+    while (pt_draining > 0)
+    {
+        spinlock_release(&pt_lock);
+        thread_yield();
+        spinlock_acquire(&pt_lock);
+        pt_wait_resize();
+    }
+}
+
+/* a slot of this thread becomes busy (called with pt_lock held) */
+static void pt_busy_start(void)
+{
+    pt_busy++;
+    curthread->t_ptbusy++;
+}
+
+/* a slot of this thread is no longer busy (called with pt_lock held) */
+static void pt_busy_end(void)
+{
+    KASSERT(pt_busy > 0 && curthread->t_ptbusy > 0);
+    pt_busy--;
+    curthread->t_ptbusy--;
+    if (pt_busy == 0)
+        wchan_wakeall(pt_fill_wchan, &pt_lock);
+}
+
+/*
+ * Wait until no frame is being filled and no resize is in progress
+ * (called with pt_lock held, returns with it held). Fails at once if
+ * this thread is filling a frame: that fill would never end.
+ */
+static int pt_drain_fills(void)
+{
+    if (curthread->t_ptbusy > 0)
+        return EBUSY;
+    pt_draining++;
+    for (;;)
+    {
+        pt_wait_resize();
+        if (pt_busy == 0)
+            break;
+        wchan_sleep(pt_fill_wchan, &pt_lock);
+    }
+    pt_draining--;
+    return 0;
 }
 
-/* returns the index of the page at address v_addr in the pagetable using an hash function */
+/* returns the index of the cluster of the page at address v_addr (mips_utlb_refill computes the same) */
 static int pt_hash(vaddr_t v_addr, pid_t pid)
 {
-    int res = (int)(v_addr >> 12);
-    return (res * pid) % nClusters;
+    uint32_t vpn = v_addr >> 12, key = (uint32_t)pid << 20 | vpn;
+
+    switch (pt_hash_kind)
+    {
+    case PT_HASH_MULT:
+        key *= 0x9e3779b1;
+        break;
+    case PT_HASH_XOR:
+        key ^= key << 13;
+        key ^= key >> 17;
+        key ^= key << 5;
+        break;
+    default:
+        key = vpn * (uint32_t)pid;
+        break;
+    }
+    return key % (uint32_t)nClusters;
+}
+
+/* copy the next word of the command at *p into word (truncated to size - 1), 0 at the end of the command */
+static unsigned int pt_next_word(const char **p, char *word, unsigned int size)
+{
+    const char *s = *p;
+    unsigned int n = 0;
+
+    for (; *s == ' ' || *s == '\t'; s++)
+        ;
+    for (; *s != '\0' && *s != ';' && *s != ' ' && *s != '\t'; s++)
+    {
+        if (n < size - 1)
+            word[n++] = *s;
+    }
+    word[n] = '\0';
+    *p = s;
+    return n;
+}
+
+/* parse one argument of "ptconf [assoc] [hash]"; returns 0 if it is valid */
+static int pt_parse_word(const char *word, int *assoc, unsigned int *hash)
+{
+    unsigned int i;
+
+    if (word[0] >= '0' && word[0] <= '9')
+    {
+        *assoc = atoi(word);
+        return *assoc == 2 || *assoc == 4 || *assoc == 8 || *assoc == 16 ? 0 : EINVAL;
+    }
+    for (i = 0; i < sizeof(pt_hash_names) / sizeof(pt_hash_names[0]); i++)
+    {
+        if (!strcmp(word, pt_hash_names[i]))
+        {
+            *hash = i;
+            return 0;
+        }
+    }
+    return EINVAL;
+}
+
+/*
+ * The geometry of the page table is fixed once the coremap exists, so
+ * it is configured by a "ptconf <2|4|8|16> <mod|mult|xor>" command in
+ * the boot arguments, looked for before vm_bootstrap. The menu then
+ * runs the command again, which only prints the configuration.
+ */
+void pt_boot_options(const char *args)
+{
+    int assoc = pt_cluster_size;
+    unsigned int hash = pt_hash_kind;
+    char word[8];
+
+    if (args == NULL)
+        return;
+    while (*args != '\0')
+    {
+        if (pt_next_word(&args, word, sizeof(word)) != 0 && !strcmp(word, "ptconf"))
+        {
+            while (pt_next_word(&args, word, sizeof(word)) != 0)
+            {
+                if (pt_parse_word(word, &assoc, &hash))
+                {
+                    kprintf("ptconf: usage: ptconf [2|4|8|16] [mod|mult|xor]\n");
+                    return;
+                }
+            }
+            pt_cluster_size = assoc;
+            pt_hash_kind = hash;
+        }
+        // skip the rest of the command
+        for (; *args != '\0' && *args != ';'; args++)
+            ;
+        if (*args == ';')
+            args++;
+    }
+}
+
+/* returns 0 if "ptconf" with these arguments matches the configuration chosen at boot */
+int pt_check_config(int nargs, char **args)
+{
+    int assoc = pt_cluster_size;
+    unsigned int hash = pt_hash_kind;
+    int i;
+
+    for (i = 0; i < nargs; i++)
+    {
+        if (pt_parse_word(args[i], &assoc, &hash))
+            return EINVAL;
+    }
+    return assoc == pt_cluster_size && hash == pt_hash_kind ? 0 : EBUSY;
+}
+
+/* print the page table configuration */
+void pt_print_config(void)
+{
+    kprintf("page table: %d-way clusters, %s hash, %d clusters\n",
+            pt_cluster_size, pt_hash_names[pt_hash_kind], nClusters);
+}
+
+/* count the eviction of a page from a full cluster (called with pt_lock held) */
+static void pt_count_eviction(void)
+{
+    unsigned int nfree, b;
+
+    pt_evictions++;
+    nfree = nClusters * CLUSTER_SIZE - pt_used;
+    if (nfree == 0)
+        return;
+    for (b = 0; b < PT_CONFLICT_BUCKETS - 1 && (nfree >> (b + 1)) != 0; b++)
+        ;
+    pt_conflicts[b]++;
+}
+
+/* map the shared zero frame read-only at v_addr */
+static void pt_map_zero(vaddr_t v_addr)
+{
+    tlb_insert(v_addr, zero_frame, 0);
+    vms_update(VMS_FAULTS_ZEROED);
+    vms_update(VMS_ZEROPAGE_MAPS);
+}
+
+/* load the pages of a mapped file that follow v_addr into free frames, without mapping them in the TLB */
+static void pt_readahead(struct segment *seg, vaddr_t v_addr, pid_t pid)
+{
+    int i, k, slot, fromfile, result;
+    pt_entry *ptr;
+    paddr_t p_addr;
+
+    for (k = 0; k < PT_READAHEAD; k++)
+    {
+        v_addr += PAGE_SIZE;
+        if (v_addr >= SEG_END(seg) || v_addr >= seg->s_elfbase + seg->s_filesize)
+            break;
+        // a private page written and swapped out must not be read again from the file
+        if (swap_in(v_addr, 0, pid, SWAP_LOOKUP))
+            continue;
+
+        slot = -1;
+        spinlock_acquire(&pt_lock);
+        pt_wait_fill();
+        ptr = pagetable + pt_hash(v_addr, pid) * CLUSTER_SIZE;
+        for (i = 0; i < CLUSTER_SIZE; i++)
+        {
+            if (PT_V_ADDR(ptr[i]) == v_addr && PT_PID(ptr[i]) == pid)
+            {
+                slot = -1;
+                break;
+            }
+            if (slot < 0 && ptr[i] == 0)
+                slot = i;
+        }
+        if (slot < 0)
+        {
+            // already in memory, or no free frame: read-ahead never evicts a page
+            spinlock_release(&pt_lock);
+            continue;
+        }
+        ptr[slot] = v_addr | (pid << 1) | PT_BUSY_BIT;
+        if (seg->s_flags & SEG_W)
+            ptr[slot] |= 1;
+        pt_used++;
+        pt_busy_start();
+        p_addr = PT_P_ADDR((ptr - pagetable) + slot + start_cluster * CLUSTER_SIZE);
+        spinlock_release(&pt_lock);
+
+        result = fill_page(seg, v_addr, p_addr, &fromfile);
+        // no resize while the slot is busy: ptr still points to it
+        spinlock_acquire(&pt_lock);
+        if (result)
+        {
+            ptr[slot] = 0;
+            pt_used--;
+        }
+        else
+        {
+            ptr[slot] &= ~PT_BUSY_BIT;
+        }
+        pt_busy_end();
+        spinlock_release(&pt_lock);
+        if (result)
+            break;
+        seg_touch(seg, v_addr);
+        vms_update(VMS_READAHEAD);
+    }
+}
+
+/* returns a random entry of the (full) cluster at ptr that is not being filled, only among clean pages if clean is set; -1 if none */
+static int pt_pick_victim(pt_entry *ptr, int clean)
+{
+    int k, i, start = random() % CLUSTER_SIZE;
+
+    for (k = 0; k < CLUSTER_SIZE; k++)
+    {
+        i = (start + k) % CLUSTER_SIZE;
+        if (!PT_BUSY(ptr[i]) && !(clean && PT_DIRTY(ptr[i])))
+            return i;
+    }
+    return -1;
 }
 
 /* returns the entry corresponding to the page associated to the address v_addr (if that page is not in memory it will be loaded)
+   and in *path how the fault was served (VMT_*)
 */
-int pt_get_page(vaddr_t v_addr)
+int pt_get_page(vaddr_t v_addr, int faulttype, int *path)
 {
     v_addr &= PAGE_FRAME;
     pid_t pid = curproc->pid;
-    int i, write, exec, first_free = -1;
+    int i, write, zero, first_free = -1, swap_slot = -1, oom_tries = 0;
+    paddr_t p_addr;
     struct addrspace *as = proc_getas();
+    struct segment *seg;
 
-    // get segment of v_addr to get flags
-    if (v_addr >= as->as_vbase1 && v_addr < as->as_vbase1 + as->as_npages1 * PAGE_SIZE)
+    if (curproc->p_oomkilled)
     {
-        // segment 1
-        write = as->as_flags & 0x2;
-        exec = as->as_flags & 0x1;
+        // chosen by the OOM killer, which took its pages away: it dies on its way back to user mode
+        return ERR_CODE;
     }
-    else if (v_addr >= as->as_vbase2 && v_addr < as->as_vbase2 + as->as_npages2 * PAGE_SIZE)
+
+    // get segment of v_addr to get flags
+    seg = seg_find(as, v_addr);
+    if (seg == NULL)
     {
-        // segment 2
-        write = as->as_flags & 0x10;
-        exec = as->as_flags & 0x8;
+        // below the stack: grow it (up to the stack limit)
+        seg = seg_grow_stack(as, v_addr);
     }
-    else if (v_addr >= USERSTACK - STACKPAGES * PAGE_SIZE && v_addr < USERSTACK)
+    if (seg == NULL)
     {
-        // stack
-        exec = 0;
-        write = 1;
+        // page out of segments
+        return ERR_CODE;
     }
-    else
+    if (!(seg->s_flags & (SEG_R | SEG_W | SEG_X)))
     {
-        // page out of segments
+        // PROT_NONE mapping
         return ERR_CODE;
     }
+    write = seg->s_flags & SEG_W;
+    zero = seg->s_backing == SEG_BACKING_ZERO || v_addr >= seg->s_elfbase + seg->s_filesize;
+
+    if (faulttype == VM_FAULT_READONLY)
+    {
+        // the only read-only mapping of a writable page is the zero page
+        if (!write)
+            return ERR_CODE;
+        tlb_invalidate_vaddr(v_addr);
+    }
+    // reads of a zero-fill page that was never written share the zero frame
+    zero = zero && write && faulttype == VM_FAULT_READ;
 
     // ricerca nella PT
-    pt_entry *ptr = pagetable + pt_hash(v_addr, pid) * CLUSTER_SIZE;
+    pt_entry *ptr, entry, victim = 0;
+search:
     spinlock_acquire(&pt_lock);
+    pt_wait_fill();
+    ptr = pagetable + pt_hash(v_addr, pid) * CLUSTER_SIZE;
     for (i = 0; i < CLUSTER_SIZE; i++)
     {
         if (PT_V_ADDR(ptr[i]) == v_addr && PT_PID(ptr[i]) == pid)
         {
+            if (PT_BUSY(ptr[i]))
+            {
+                // still being filled (cannot happen with one thread per process): wait for it
+                spinlock_release(&pt_lock);
+                thread_yield();
+                first_free = -1;
+                goto search;
+            }
+            p_addr = PT_P_ADDR((ptr - pagetable) + i + start_cluster * CLUSTER_SIZE);
+            write = PT_DIRTY(ptr[i]);
+            // under pt_lock: the slot cannot be given to another page before the entry is in the TLB
+            tlb_insert(v_addr, p_addr, write);
             spinlock_release(&pt_lock);
-            tlb_insert(v_addr, PT_P_ADDR((ptr - pagetable) + i + start_cluster * CLUSTER_SIZE));
             // update stats
             vms_update(VMS_RELOAD);
+            *path = VMT_RELOAD;
             return 0;
         }
         else if (first_free < 0 && ptr[i] == 0)
@@ -84,72 +474,138 @@ int pt_get_page(vaddr_t v_addr)
         }
     }
 
+    if (zero)
+    {
+        spinlock_release(&pt_lock);
+        if (!swap_in(v_addr, 0, pid, SWAP_LOOKUP))
+        {
+            pt_map_zero(v_addr);
+            *path = VMT_ZERO;
+            return 0;
+        }
+        // written before and swapped out: load it as usual
+        zero = 0;
+        first_free = -1;
+        goto search;
+    }
+
     if (i >= CLUSTER_SIZE && first_free < 0)
     {
-        // swap out
-        i = random() % CLUSTER_SIZE;
-        if (PT_DIRTY(ptr[i]))
+        // swap out a random page of the cluster (frames being filled are not candidates)
+        i = pt_pick_victim(ptr, 0);
+        if (i < 0)
         {
-            // swap out physical page i
             spinlock_release(&pt_lock);
-            //inside swap_out we acqurie another spinlock
-            swap_out(PT_V_ADDR(ptr[i]), PT_P_ADDR((ptr - pagetable) + i + start_cluster * CLUSTER_SIZE), PT_PID(ptr[i])); 
-            spinlock_acquire(&pt_lock);
+            thread_yield();
+            first_free = -1;
+            goto search;
         }
-        // invalid tlb entry
-        int j = tlb_probe(PT_V_ADDR(ptr[i]), 0);
-        if (j >= 0)
+        // from here a fault on the old page finds it in the swapfile (waiting for the write to end)
+        if (PT_DIRTY(ptr[i]) && (swap_slot = swap_reserve(PT_V_ADDR(ptr[i]), PT_PID(ptr[i]))) < 0)
         {
-            tlb_write(TLBHI_INVALID(j), TLBLO_INVALID(), j);
+            // swapfile full: only a clean page can be dropped
+            i = pt_pick_victim(ptr, 1);
+            if (i < 0)
+            {
+                spinlock_release(&pt_lock);
+                // the OOM killer releases the pages of a victim (this process itself: the fault fails and it dies)
+                if (oom_kill() || ++oom_tries > OOM_RETRIES)
+                    return ERR_CODE;
+                thread_yield();
+                first_free = -1;
+                goto search;
+            }
         }
+        victim = ptr[i];
+        pt_count_eviction();
     }
     else
     {
         i = first_free;
+        pt_used++;
     }
-    ptr[i] = v_addr | (pid << 1);
+    // the slot is taken (busy) before pt_lock is dropped: no other fault can pick it as a victim or reload the old page
+    entry = v_addr | (pid << 1);
     if (write)
-        ptr[i] |= 1;
-
+        entry |= 1;
+    ptr[i] = entry | PT_BUSY_BIT;
+    pt_busy_start();
+    p_addr = PT_P_ADDR((ptr - pagetable) + i + start_cluster * CLUSTER_SIZE);
     spinlock_release(&pt_lock);
+    seg_touch(seg, v_addr);
 
-    tlb_insert(v_addr, PT_P_ADDR((ptr - pagetable) + i + start_cluster * CLUSTER_SIZE)); // la TLB deve essere settata prima di fare le operazioni di lettura
+    if (victim != 0)
+    {
+        vms_update(VMS_EVICTIONS);
+        // the owner of the old page may be running on another CPU: it must stop using the frame first
+        tlb_shootdown(PT_V_ADDR(victim), PT_PID(victim));
+        if (swap_slot >= 0)
+            swap_write_slot(swap_slot, p_addr);
+    }
 
-    if (!swap_in(v_addr, pid, SWAP_LOAD))
+    // the frame is filled through kseg0: the page is not visible to the process until the TLB entry is written
+    if (swap_in(v_addr, p_addr, pid, SWAP_LOAD))
+    {
+        *path = VMT_SWAPIN;
+    }
+    else
     {
-        if (load_page(v_addr, exec))
+        if (seg->s_backing == SEG_BACKING_ZERO || v_addr >= seg->s_elfbase + seg->s_filesize)
+            *path = VMT_ZERO;
+        else
+            *path = seg->s_backing == SEG_BACKING_FILE ? VMT_MMAP : VMT_ELF;
+        if (load_page(seg, v_addr, p_addr))
         {
-            // stop processo corrente
+            // the slot goes back empty; stop processo corrente
+            spinlock_acquire(&pt_lock);
+            KASSERT(ptr[i] == (entry | PT_BUSY_BIT));
+            ptr[i] = 0;
+            pt_used--;
+            pt_busy_end();
+            spinlock_release(&pt_lock);
             return ERR_CODE;
         }
     }
 
-    if (!write)
-    {
-        uint32_t pos = tlb_probe(v_addr, 0);
-        tlb_write(v_addr, PT_P_ADDR((ptr - pagetable) + i + start_cluster * CLUSTER_SIZE) | TLBLO_VALID, pos);
-    }
+    // no resize starts while a slot is busy and nobody else clears it: ptr and p_addr are still valid
+    spinlock_acquire(&pt_lock);
+    KASSERT(ptr[i] == (entry | PT_BUSY_BIT));
+    ptr[i] = entry;
+    pt_busy_end();
+    // read-only pages never get the dirty bit, not even for a moment; the slot cannot be a victim before this
+    tlb_insert(v_addr, p_addr, write);
+    spinlock_release(&pt_lock);
+
+    // after the slot is released: read-ahead waits for resizes, which wait for busy slots
+    if (*path == VMT_MMAP)
+        pt_readahead(seg, v_addr, pid);
+
+    // the time of the write to the swapfile dominates, whatever the page was loaded from
+    if (swap_slot >= 0)
+        *path = VMT_EVICT;
 
     return 0;
 }
 
-/* delete all pages of this process from page table */
-void pt_delete_PID(struct addrspace *as, pid_t pid)
+/* delete the pages in [start, end) of process pid from page table and swapfile */
+void pt_delete_range(vaddr_t start, vaddr_t end, pid_t pid)
 {
-    unsigned int i, j, found = 0;
+    unsigned int j, found;
     pt_entry *ptr;
     vaddr_t addr;
 
-    /* clean first segment */
-    for (i = 0, addr = as->as_vbase1; i < as->as_npages1; i++, addr += PAGE_SIZE)
+    for (addr = start; addr < end; addr += PAGE_SIZE)
     {
-        ptr = pagetable + pt_hash(addr, pid) * CLUSTER_SIZE;
+        found = 0;
         spinlock_acquire(&pt_lock);
+        pt_wait_resize();
+        ptr = pagetable + pt_hash(addr, pid) * CLUSTER_SIZE;
         for (j = 0; j < CLUSTER_SIZE; j++)
         {
             if (PT_V_ADDR(*(ptr + j)) == addr && PT_PID(*(ptr + j)) == pid)
             {
                 *(ptr + j) = 0;
+                pt_used--;
                 found = 1;
                 break;
             }
@@ -158,88 +614,141 @@ void pt_delete_PID(struct addrspace *as, pid_t pid)
         if (!found)
         {
             // remove from swap if present
-            swap_in(addr, pid, SWAP_DISCARD);
+            swap_in(addr, 0, pid, SWAP_DISCARD);
         }
     }
-    /* clean second segment */
-    found = 0;
-    for (i = 0, addr = as->as_vbase2; i < as->as_npages2; i++, addr += PAGE_SIZE)
+}
+
+/* delete all pages of this process from page table */
+void pt_delete_PID(struct addrspace *as, pid_t pid)
+{
+    unsigned int s;
+
+    // pages that never got a frame are neither in the page table nor in the swapfile
+    for (s = 0; s < as->as_nsegs; s++)
     {
-        ptr = pagetable + pt_hash(addr, pid) * CLUSTER_SIZE;
-        spinlock_acquire(&pt_lock);
-        for (j = 0; j < CLUSTER_SIZE; j++)
-        {
-            if (PT_V_ADDR(*(ptr + j)) == addr && PT_PID(*(ptr + j)) == pid)
-            {
-                *(ptr + j) = 0;
-                found = 1;
-                break;
-            }
-        }
-        spinlock_release(&pt_lock);
-        if (!found)
-        {
-            // remove from swap if present
-            swap_in(addr, pid, SWAP_DISCARD);
-        }
+        pt_delete_range(as->as_segs[s].s_touchlo, as->as_segs[s].s_touchhi, pid);
     }
-    /* clean stack */
-    addr = USERSTACK - STACKPAGES * PAGE_SIZE;
-    for (i = 0; i < STACKPAGES; i++, addr += PAGE_SIZE)
+    // a new process may get the same pid: the entries left in the TLBs must not be kept for it
+    tlb_forget(pid);
+}
+
+/*
+ * Release the pages of process pid, chosen by the OOM killer, from the
+ * page table and the swapfile, whatever the process is doing: it may be
+ * asleep in the kernel and not get back to user mode for a long time.
+ * Faults wait as during a resize, so no frame is reused before every CPU
+ * has dropped the entries of the process; a frame it is filling stays.
+ * Returns the number of pages released.
+ */
+unsigned int pt_reap(pid_t pid)
+{
+    int i;
+    unsigned int n = 0;
+    struct thread *prev_resizer;
+
+    spinlock_acquire(&pt_lock);
+    pt_wait_resize();
+    prev_resizer = pt_resizer;
+    pt_resizer = curthread;
+    spinlock_release(&pt_lock);
+
+    // no page can be added to the process from here: if it still has its address space, it still has its pid
+    if (proc_oom_pending(pid))
     {
-        ptr = pagetable + pt_hash(addr, pid) * CLUSTER_SIZE;
         spinlock_acquire(&pt_lock);
-        for (j = 0; j < CLUSTER_SIZE; j++)
+        for (i = 0; i < nClusters * CLUSTER_SIZE; i++)
         {
-            if (PT_V_ADDR(*(ptr + j)) == addr && PT_PID(*(ptr + j)) == pid)
+            if (pagetable[i] != 0 && !PT_BUSY(pagetable[i]) && PT_PID(pagetable[i]) == pid)
             {
-                *(ptr + j) = 0;
-                found = 1;
-                break;
+                pagetable[i] = 0;
+                pt_used--;
+                n++;
             }
         }
         spinlock_release(&pt_lock);
-        if (!found)
-        {
-            // remove from swap if present
-            swap_in(addr, pid, SWAP_DISCARD);
-        }
+        tlb_shootdown_all();
+        n += swap_discard_pid(pid);
     }
+
+    spinlock_acquire(&pt_lock);
+    pt_resizer = prev_resizer;
+    spinlock_release(&pt_lock);
+    return n;
+}
+
+/* number of pages that a change of geometry has to write to the swapfile (called with pt_lock held) */
+static int pt_count_dirty(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < nClusters * CLUSTER_SIZE; i++)
+    {
+        if (pagetable[i] != 0 && PT_DIRTY(pagetable[i]))
+            n++;
+    }
+    return n;
+}
+
+/* allocate n_pages contiguous frames only if they are already free, never taking clusters from the page table */
+paddr_t pt_getfreekpages(uint32_t n_pages)
+{
+    paddr_t paddr;
+
+    // not while a resize is handing frames over to the kernel: they are meant for the resizer
+    spinlock_acquire(&pt_lock);
+    pt_wait_resize();
+    paddr = getFreePages(n_pages);
+    spinlock_release(&pt_lock);
+    return paddr;
 }
 
 paddr_t pt_getkpages(uint32_t n_pages)
 {
     unsigned int i, tmp_start_cluster, tmp_nClusters;
+    int result;
     paddr_t paddr;
+    struct thread *prev_resizer;
     unsigned int n_cluster_to_allocate = (n_pages + CLUSTER_SIZE) / CLUSTER_SIZE;
     spinlock_acquire(&pt_lock);
+    pt_wait_resize();
 
     paddr = getFreePages(n_pages);
+    // frames being filled cannot be handed over: wait for the fills to end (frames may be freed meanwhile)
+    if(paddr == 0 && pt_busy > 0 && pt_drain_fills() == 0){
+        paddr = getFreePages(n_pages);
+    }
 
     if(paddr != 0){
         spinlock_release(&pt_lock);
         return paddr;
     }
 
-    if(nClusters - (int)n_cluster_to_allocate < 0){
-        n_cluster_to_allocate = nClusters;
+    // the last cluster is never given away, every dirty page must fit in the swapfile, and no frame may be in use by a fill
+    if(pt_busy > 0 || (int)n_cluster_to_allocate >= nClusters || pt_count_dirty() > swap_free_slots()){
+        spinlock_release(&pt_lock);
+        return 0;
     }
     tmp_start_cluster = start_cluster;
     tmp_nClusters = nClusters;
 
+    prev_resizer = pt_resizer;
+    pt_resizer = curthread;
+    pt_refill_disable();
     start_cluster += n_cluster_to_allocate;
     nClusters -= n_cluster_to_allocate;
 
-    tlb_invalidate();
+    // every frame changes owner: no CPU may keep an entry of the old page table
+    spinlock_release(&pt_lock);
+    tlb_shootdown_all();
+    spinlock_acquire(&pt_lock);
     for (i = (tmp_start_cluster) * CLUSTER_SIZE; i < (unsigned int)(tmp_start_cluster + n_cluster_to_allocate) * CLUSTER_SIZE; i++){
         free_ppage(i * PAGE_SIZE);
     }
     paddr = getFreePages(n_pages);
-    if(paddr == 0){
-        spinlock_release(&pt_lock);
-        panic("Out of memory!\n");
-    }
-    
+    // the clusters taken are contiguous and enough for n_pages
+    KASSERT(paddr != 0);
+
     for (i = 0; i < (unsigned int)tmp_nClusters * CLUSTER_SIZE; i++)
     {
         pt_entry entry = pagetable[i];
@@ -248,10 +757,15 @@ paddr_t pt_getkpages(uint32_t n_pages)
         {
             // swap out
             spinlock_release(&pt_lock);
-            swap_out(PT_V_ADDR(entry), PT_P_ADDR(i + tmp_start_cluster * CLUSTER_SIZE), PT_PID(entry));
+            // room checked before the resize, and no fault can reserve a slot until it ends
+            result = swap_out(PT_V_ADDR(entry), PT_P_ADDR(i + tmp_start_cluster * CLUSTER_SIZE), PT_PID(entry));
+            KASSERT(result == 0);
             spinlock_acquire(&pt_lock);
         }
     }
+    pt_used = 0;
+    pt_refill_update();
+    pt_resizer = prev_resizer;
     spinlock_release(&pt_lock);
     return paddr;
 }
@@ -259,16 +773,32 @@ paddr_t pt_getkpages(uint32_t n_pages)
 void pt_freekpages(uint32_t page)
 {
     unsigned int i, tmp_start_cluster, n_clusters;
+    int result;
+    struct thread *prev_resizer;
     spinlock_acquire(&pt_lock);
+    pt_wait_resize();
 
+    // the frames go back to the kernel, and whole free clusters at the end of its memory to the page table:
+    // once the fills are over (a resize would move their frames under their feet),
+    // and only if there is room in the swapfile for the dirty pages
     n_clusters = return_mem(page);
-    if(nClusters == 0){
+    if(n_clusters == 0 || nClusters == 0 || pt_drain_fills() || pt_count_dirty() > swap_free_slots() ||
+       (n_clusters = give_back_mem()) == 0){
         spinlock_release(&pt_lock);
         return;
     }
+    prev_resizer = pt_resizer;
+    pt_resizer = curthread;
+    pt_refill_disable();
+    // the entries still refer to the frames of the old geometry
+    tmp_start_cluster = start_cluster;
     start_cluster -= n_clusters;
     nClusters += n_clusters;
-    tmp_start_cluster = start_cluster;
+
+    // every frame changes owner: no CPU may keep an entry of the old page table
+    spinlock_release(&pt_lock);
+    tlb_shootdown_all();
+    spinlock_acquire(&pt_lock);
     for (i = 0; i < (unsigned int)nClusters * CLUSTER_SIZE; i++)
     {
         pt_entry entry = pagetable[i];
@@ -277,11 +807,15 @@ void pt_freekpages(uint32_t page)
         {
             // swap out
             spinlock_release(&pt_lock);
-            swap_out(PT_V_ADDR(entry), PT_P_ADDR(i + tmp_start_cluster * CLUSTER_SIZE), PT_PID(entry));
+            // room checked before the resize, and no fault can reserve a slot until it ends
+            result = swap_out(PT_V_ADDR(entry), PT_P_ADDR(i + tmp_start_cluster * CLUSTER_SIZE), PT_PID(entry));
+            KASSERT(result == 0);
             spinlock_acquire(&pt_lock);
         }
     }
-    tlb_invalidate();
+    pt_used = 0;
+    pt_refill_update();
+    pt_resizer = prev_resizer;
     spinlock_release(&pt_lock);
 }
 
@@ -304,4 +838,126 @@ int pt_stats(void)
     }
     spinlock_release(&pt_lock);
     return pfree;
-}
\ No newline at end of file
+}
+/* add to counts[pid] the frames held by each process */
+void pt_usage(unsigned int *counts)
+{
+    int i;
+
+    spinlock_acquire(&pt_lock);
+    pt_wait_resize();
+    for (i = 0; i < nClusters * CLUSTER_SIZE; i++)
+    {
+        if (pagetable[i] != 0)
+            counts[PT_PID(pagetable[i])]++;
+    }
+    spinlock_release(&pt_lock);
+}
+
+/*
+ * Snapshot of the page table for pt_report, taken under pt_lock and
+ * printed after releasing it.
+ */
+struct pt_snapshot {
+    int clusters, used, evictions, conflicts;
+    unsigned int occupancy[PT_MAX_CLUSTER_SIZE + 1]; /* clusters by number of used entries */
+    unsigned int conflict_hist[PT_CONFLICT_BUCKETS];
+    unsigned int pid_frames[PID_MAX];               /* frames held by each pid */
+    unsigned int sumsq;                             /* sum of the squared cluster loads */
+};
+
+/*
+ * Report on the clustered hash: occupancy of the clusters, conflict
+ * evictions, frames per process and how far the cluster loads are
+ * from those of a uniform hash. With dump set, one key=value per line.
+ */
+void pt_report(int dump)
+{
+    struct pt_snapshot *ps;
+    int c, i, load, pid;
+    unsigned int b, mean_m, var_m, unif_m;
+
+    ps = kmalloc(sizeof(*ps));
+    if (ps == NULL)
+    {
+        kprintf("pt_report: out of memory\n");
+        return;
+    }
+    bzero(ps, sizeof(*ps));
+
+    spinlock_acquire(&pt_lock);
+    ps->clusters = nClusters;
+    ps->used = pt_used;
+    ps->evictions = pt_evictions;
+    for (b = 0; b < PT_CONFLICT_BUCKETS; b++)
+    {
+        ps->conflict_hist[b] = pt_conflicts[b];
+        ps->conflicts += pt_conflicts[b];
+    }
+    for (c = 0; c < nClusters; c++)
+    {
+        load = 0;
+        for (i = 0; i < CLUSTER_SIZE; i++)
+        {
+            if (pagetable[c * CLUSTER_SIZE + i] == 0)
+                continue;
+            load++;
+            pid = PT_PID(pagetable[c * CLUSTER_SIZE + i]);
+            if (pid < PID_MAX)
+                ps->pid_frames[pid]++;
+        }
+        ps->occupancy[load]++;
+        ps->sumsq += load * load;
+    }
+    spinlock_release(&pt_lock);
+
+    /*
+     * Hash quality, in thousandths: the variance of the cluster loads
+     * against the binomial variance n/m * (1 - 1/m) that a uniform hash
+     * gives n keys over m clusters (before the clusters fill up).
+     */
+    mean_m = ps->clusters ? ps->used * 1000 / ps->clusters : 0;
+    var_m = ps->clusters ? ps->sumsq * 1000 / ps->clusters : 0;
+    var_m = var_m > mean_m * mean_m / 1000 ? var_m - mean_m * mean_m / 1000 : 0;
+    unif_m = ps->clusters ? mean_m - mean_m / ps->clusters : 0;
+
+    if (dump)
+    {
+        kprintf("pt.clusters=%d\npt.cluster_size=%d\npt.hash=%s\npt.used=%d\n",
+                ps->clusters, CLUSTER_SIZE, pt_hash_names[pt_hash_kind], ps->used);
+        kprintf("pt.evictions=%d\npt.conflicts=%d\n", ps->evictions, ps->conflicts);
+        for (i = 0; i <= CLUSTER_SIZE; i++)
+            kprintf("pt.occupancy.%d=%u\n", i, ps->occupancy[i]);
+        for (b = 0; b < PT_CONFLICT_BUCKETS; b++)
+            if (ps->conflict_hist[b] != 0)
+                kprintf("pt.conflict.%u=%u\n", 1U << b, ps->conflict_hist[b]);
+        for (pid = 0; pid < PID_MAX; pid++)
+            if (ps->pid_frames[pid] != 0)
+                kprintf("pt.pid.%d=%u\n", pid, ps->pid_frames[pid]);
+        kprintf("pt.load_mean_milli=%u\npt.load_var_milli=%u\npt.uniform_var_milli=%u\n", mean_m, var_m, unif_m);
+        kfree(ps);
+        return;
+    }
+
+    kprintf("page table: %d clusters of %d (%s hash), %d/%d frames used\n",
+            ps->clusters, CLUSTER_SIZE, pt_hash_names[pt_hash_kind], ps->used, ps->clusters * CLUSTER_SIZE);
+    kprintf("cluster occupancy:");
+    for (i = 0; i <= CLUSTER_SIZE; i++)
+        kprintf(" %d:%u", i, ps->occupancy[i]);
+    kprintf("\nevictions: %d, with free frames elsewhere: %d\n", ps->evictions, ps->conflicts);
+    if (ps->conflicts != 0)
+    {
+        kprintf("  free frames at the time:");
+        for (b = 0; b < PT_CONFLICT_BUCKETS; b++)
+            if (ps->conflict_hist[b] != 0)
+                kprintf(" >=%u:%u", 1U << b, ps->conflict_hist[b]);
+        kprintf("\n");
+    }
+    kprintf("frames per pid:");
+    for (pid = 0; pid < PID_MAX; pid++)
+        if (ps->pid_frames[pid] != 0)
+            kprintf(" %d:%u", pid, ps->pid_frames[pid]);
+    kprintf("\ncluster load: mean %u.%03u, variance %u.%03u (uniform hash %u.%03u)\n",
+            mean_m / 1000, mean_m % 1000, var_m / 1000, var_m % 1000, unif_m / 1000, unif_m % 1000);
+    kfree(ps);
+}
@@ -0,0 +1,334 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <addrspace.h>
+#include <segments.h>
+#include <vnode.h>
+
+/*
+ * The regions of an address space are kept in an array sorted by
+ * base address, so that the lookup done on every page fault is a
+ * binary search. Regions never overlap.
+ */
+
+#define SEG_INITIAL_MAX 4
+
+/* init the (empty) segment list of an address space */
+void seg_init(struct addrspace *as)
+{
+	as->as_segs = NULL;
+	as->as_nsegs = 0;
+	as->as_maxsegs = 0;
+}
+
+/* free the segment list of an address space */
+void seg_destroy(struct addrspace *as)
+{
+	unsigned i;
+
+	for (i = 0; i < as->as_nsegs; i++)
+	{
+		if (as->as_segs[i].s_vnode != NULL)
+		{
+			VOP_DECREF(as->as_segs[i].s_vnode);
+		}
+	}
+	kfree(as->as_segs);
+	seg_init(as);
+}
+
+/* make room for at least n segments */
+static int seg_reserve(struct addrspace *as, unsigned n)
+{
+	struct segment *segs;
+	unsigned max;
+
+	if (n <= as->as_maxsegs)
+	{
+		return 0;
+	}
+	max = as->as_maxsegs == 0 ? SEG_INITIAL_MAX : as->as_maxsegs;
+	while (max < n)
+	{
+		max *= 2;
+	}
+	segs = kmalloc(max * sizeof(struct segment));
+	if (segs == NULL)
+	{
+		return ENOMEM;
+	}
+	if (as->as_nsegs > 0)
+	{
+		memcpy(segs, as->as_segs, as->as_nsegs * sizeof(struct segment));
+	}
+	kfree(as->as_segs);
+	as->as_segs = segs;
+	as->as_maxsegs = max;
+	return 0;
+}
+
+/* returns the index of the first region that ends after vaddr (as_nsegs if none) */
+static unsigned seg_search(struct addrspace *as, vaddr_t vaddr)
+{
+	unsigned lo = 0, hi = as->as_nsegs, mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if (SEG_END(&as->as_segs[mid]) <= vaddr)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* insert a region keeping the list sorted; fails with EINVAL if it overlaps another one */
+int seg_add(struct addrspace *as, const struct segment *seg)
+{
+	unsigned pos;
+	int result;
+
+	KASSERT((seg->s_vbase & PAGE_FRAME) == seg->s_vbase);
+
+	/* empty regions (a heap before the first sbrk) are allowed, but still take their place */
+	pos = seg_search(as, seg->s_vbase);
+	if (pos < as->as_nsegs && as->as_segs[pos].s_vbase < SEG_END(seg))
+	{
+		return EINVAL;
+	}
+
+	result = seg_reserve(as, as->as_nsegs + 1);
+	if (result)
+	{
+		return result;
+	}
+	memmove(&as->as_segs[pos + 1], &as->as_segs[pos],
+		(as->as_nsegs - pos) * sizeof(struct segment));
+	as->as_segs[pos] = *seg;
+	as->as_nsegs++;
+	return 0;
+}
+
+/* returns the region containing vaddr (binary search), NULL if there is none */
+struct segment *seg_find(struct addrspace *as, vaddr_t vaddr)
+{
+	unsigned pos;
+
+	pos = seg_search(as, vaddr);
+	if (pos < as->as_nsegs && as->as_segs[pos].s_vbase <= vaddr)
+	{
+		return &as->as_segs[pos];
+	}
+	return NULL;
+}
+
+/* copy the segment list of old into new (which must be empty) */
+int seg_copy(struct addrspace *old, struct addrspace *new)
+{
+	unsigned i;
+	int result;
+
+	KASSERT(new->as_nsegs == 0);
+	result = seg_reserve(new, old->as_nsegs);
+	if (result)
+	{
+		return result;
+	}
+	if (old->as_nsegs > 0)
+	{
+		memcpy(new->as_segs, old->as_segs, old->as_nsegs * sizeof(struct segment));
+	}
+	new->as_nsegs = old->as_nsegs;
+	/* frames are not shared with the copy */
+	for (i = 0; i < new->as_nsegs; i++)
+	{
+		new->as_segs[i].s_touchlo = new->as_segs[i].s_touchhi = 0;
+		if (new->as_segs[i].s_vnode != NULL)
+		{
+			VOP_INCREF(new->as_segs[i].s_vnode);
+		}
+	}
+	return 0;
+}
+
+/* record that the page at vaddr got a frame (so it is freed at teardown) */
+void seg_touch(struct segment *seg, vaddr_t vaddr)
+{
+	if (seg->s_touchlo >= seg->s_touchhi)
+	{
+		seg->s_touchlo = vaddr;
+		seg->s_touchhi = vaddr + PAGE_SIZE;
+	}
+	else if (vaddr < seg->s_touchlo)
+	{
+		seg->s_touchlo = vaddr;
+	}
+	else if (vaddr + PAGE_SIZE > seg->s_touchhi)
+	{
+		seg->s_touchhi = vaddr + PAGE_SIZE;
+	}
+}
+
+/*
+ * The stack is the highest region. A fault below its base but above
+ * the stack limit extends it down to the faulting page, as long as an
+ * unmapped guard page is left between the stack and the region below.
+ */
+struct segment *seg_grow_stack(struct addrspace *as, vaddr_t vaddr)
+{
+	struct segment *stack;
+	vaddr_t base;
+
+	if (as->as_nsegs == 0)
+	{
+		return NULL;
+	}
+	stack = &as->as_segs[as->as_nsegs - 1];
+	if (!(stack->s_flags & SEG_STACK) || vaddr >= stack->s_vbase || vaddr < SEG_STACK_LIMIT)
+	{
+		return NULL;
+	}
+	base = vaddr & PAGE_FRAME;
+	if (as->as_nsegs > 1 && SEG_END(stack - 1) + PAGE_SIZE > base)
+	{
+		return NULL;
+	}
+	stack->s_npages += (stack->s_vbase - base) / PAGE_SIZE;
+	stack->s_vbase = base;
+	stack->s_elfbase = base;
+	return stack;
+}
+
+/* returns the heap region, NULL if the address space has none */
+struct segment *seg_heap(struct addrspace *as)
+{
+	unsigned i;
+
+	/* the heap sits right below the stack (and the mappings), so look from the top */
+	for (i = as->as_nsegs; i > 0; i--)
+	{
+		if (as->as_segs[i - 1].s_flags & SEG_HEAP)
+		{
+			return &as->as_segs[i - 1];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Mappings are placed top-down starting right below the lowest address
+ * the stack can reach, leaving the space above the heap for sbrk. Each
+ * mapping has an unmapped guard page above and below it.
+ */
+vaddr_t seg_find_free(struct addrspace *as, size_t npages)
+{
+	struct segment *seg;
+	vaddr_t top = SEG_STACK_LIMIT - PAGE_SIZE;
+	size_t size = npages * PAGE_SIZE;
+	unsigned i;
+
+	if (npages == 0 || size / PAGE_SIZE != npages)
+	{
+		return 0;
+	}
+	for (i = as->as_nsegs; i > 0; i--)
+	{
+		seg = &as->as_segs[i - 1];
+		if (seg->s_flags & SEG_STACK)
+		{
+			continue;
+		}
+		if (SEG_END(seg) + PAGE_SIZE <= top && top - (SEG_END(seg) + PAGE_SIZE) >= size)
+		{
+			return top - size;
+		}
+		if ((seg->s_flags & SEG_HEAP) || seg->s_vbase < 2 * PAGE_SIZE)
+		{
+			return 0;
+		}
+		top = seg->s_vbase - PAGE_SIZE;
+	}
+	return 0;
+}
+
+/* split the region at index idx in two at the page-aligned address at */
+int seg_split(struct addrspace *as, unsigned idx, vaddr_t at)
+{
+	struct segment *seg, tail;
+	size_t skip;
+	int result;
+
+	result = seg_reserve(as, as->as_nsegs + 1);
+	if (result)
+	{
+		return result;
+	}
+	seg = &as->as_segs[idx];
+	KASSERT((at & PAGE_FRAME) == at);
+	KASSERT(at > seg->s_vbase && at < SEG_END(seg));
+
+	tail = *seg;
+	tail.s_vbase = at;
+	tail.s_npages = (SEG_END(seg) - at) / PAGE_SIZE;
+	seg->s_npages = (at - seg->s_vbase) / PAGE_SIZE;
+
+	/* file data: [s_elfbase, s_elfbase + s_filesize) is divided between the two */
+	if (at > seg->s_elfbase)
+	{
+		skip = at - seg->s_elfbase;
+		tail.s_elfbase = at;
+		tail.s_offset += skip;
+		tail.s_filesize = seg->s_filesize > skip ? seg->s_filesize - skip : 0;
+		seg->s_filesize = seg->s_filesize > skip ? skip : seg->s_filesize;
+	}
+	else
+	{
+		seg->s_filesize = 0;
+	}
+
+	/* touched pages */
+	if (tail.s_touchlo < at)
+	{
+		tail.s_touchlo = at;
+	}
+	if (tail.s_touchlo >= tail.s_touchhi)
+	{
+		tail.s_touchlo = tail.s_touchhi = 0;
+	}
+	if (seg->s_touchhi > at)
+	{
+		seg->s_touchhi = at;
+	}
+	if (seg->s_touchlo >= seg->s_touchhi)
+	{
+		seg->s_touchlo = seg->s_touchhi = 0;
+	}
+
+	if (tail.s_vnode != NULL)
+	{
+		VOP_INCREF(tail.s_vnode);
+	}
+	memmove(&as->as_segs[idx + 2], &as->as_segs[idx + 1],
+		(as->as_nsegs - idx - 1) * sizeof(struct segment));
+	as->as_segs[idx + 1] = tail;
+	as->as_nsegs++;
+	return 0;
+}
+
+/* remove the region at index idx (its pages must already be released) */
+void seg_remove(struct addrspace *as, unsigned idx)
+{
+	KASSERT(idx < as->as_nsegs);
+	if (as->as_segs[idx].s_vnode != NULL)
+	{
+		VOP_DECREF(as->as_segs[idx].s_vnode);
+	}
+	memmove(&as->as_segs[idx], &as->as_segs[idx + 1],
+		(as->as_nsegs - idx - 1) * sizeof(struct segment));
+	as->as_nsegs--;
+}
@@ -1,14 +1,22 @@
 #include <swapfile.h>
+#include <spinlock.h>
+#include <thread.h>
 #define HASH_SIZE (SWAP_FILESIZE/PAGE_SIZE)
 
 #define SWAP_ENTRYPID(entry) ((int)(entry & 0x7FF))
 #define SWAP_ENTRYVADDR(entry) (entry & PAGE_FRAME)
+/* slot riservato da swap_reserve, la pagina non e' ancora stata scritta */
+#define SWAP_BUSY 0x800
+#define SWAP_TOMBSTONE 0xFFFFFFFF
+#define SWAP_ENTRYBUSY(entry) ((entry) != SWAP_TOMBSTONE && ((entry) & SWAP_BUSY))
 
 typedef uint32_t hash_entry;
 
 struct vnode *swapfile;
 
 hash_entry hash_table[HASH_SIZE];// = NULL;
+/* protegge hash_table (non viene tenuto durante l'I/O) */
+static struct spinlock swap_lock = SPINLOCK_INITIALIZER;
 
 
 
@@ -47,26 +55,17 @@ static int swap_write(int offset, vaddr_t v_addr)
 }
 
 /*  swap_read
-    int       offset: è l'offset a cui scriviamo all'interno dello swapfile
-    vaddr_t    vaddr: indirizzo logico della pagina da scrivere nello swapfile
+    int       offset: è l'offset da cui leggiamo all'interno dello swapfile
+    paddr_t   p_addr: indirizzo fisico del frame in cui copiare la pagina
     Ritorna 0 in caso di successo
 */
-static int swap_read(int offset, vaddr_t v_addr)
+static int swap_read(int offset, paddr_t p_addr)
 {
     struct iovec iov;
     struct uio u;
     int result;
 
-    iov.iov_ubase = (userptr_t)v_addr;
-    iov.iov_len = PAGE_SIZE;
-
-    u.uio_iov = &iov;
-    u.uio_iovcnt = 1;
-    u.uio_resid = PAGE_SIZE;
-    u.uio_offset = offset;
-    u.uio_segflg = UIO_USERISPACE;
-    u.uio_rw = UIO_READ;
-    u.uio_space = proc_getas();
+    uio_kinit(&iov, &u, (void *)PADDR_TO_KVADDR(p_addr), PAGE_SIZE, offset, UIO_READ);
 
     result = VOP_READ(swapfile, &u);
     if (result)
@@ -89,30 +88,52 @@ void swap_bootstrap(void)
     }
 }
 
-int swap_in(vaddr_t v_addr, pid_t pid, uint8_t store)
+int swap_in(vaddr_t v_addr, paddr_t p_addr, pid_t pid, uint8_t store)
 {
     int hash_ret;
     int i, j;
 
     hash_ret = hash_swap(v_addr, pid);
-    
+
+retry:
+    spinlock_acquire(&swap_lock);
     for(i=0, j=hash_ret; i<HASH_SIZE; i++, j=(hash_ret+i)%HASH_SIZE) {
-        if(SWAP_ENTRYVADDR(hash_table[j])==v_addr && SWAP_ENTRYPID(hash_table[j])==pid) {
+        if(SWAP_ENTRYVADDR(hash_table[j])==v_addr && SWAP_ENTRYPID(hash_table[j])==pid && hash_table[j]!=SWAP_TOMBSTONE) {
             break;
         }
 
         else if(hash_table[j]==0) {
+            spinlock_release(&swap_lock);
             return 0;
         }
     }
 
+    if(i==HASH_SIZE) {
+        spinlock_release(&swap_lock);
+        return 0;
+    }
+    if(store == SWAP_LOOKUP) {
+        spinlock_release(&swap_lock);
+        return 1;
+    }
+    if(SWAP_ENTRYBUSY(hash_table[j])) {
+        // un altro CPU la sta ancora scrivendo
+        spinlock_release(&swap_lock);
+        thread_yield();
+        goto retry;
+    }
+    spinlock_release(&swap_lock);
+
     //offset=j*PAGE_SIZE
-    if (store == SWAP_LOAD && swap_read(j*PAGE_SIZE, SWAP_ENTRYVADDR(hash_table[j])) != 0)
+    if (store == SWAP_LOAD && swap_read(j*PAGE_SIZE, p_addr) != 0)
     {
         panic("Error while reading on the swapfile.\n");
     }
 
-    hash_table[j]=0xFFFFFFFF;
+    // lo slot e' liberato solo dopo la lettura, nessuno puo' riusarlo prima
+    spinlock_acquire(&swap_lock);
+    hash_table[j]=SWAP_TOMBSTONE;
+    spinlock_release(&swap_lock);
     if(store == SWAP_LOAD){
         vms_update(VMS_FAULTS_SWAPFILE);
         vms_update(VMS_FAULTS_DISK);
@@ -121,34 +142,106 @@ int swap_in(vaddr_t v_addr, pid_t pid, uint8_t store)
     return 1;
 }
 
-void swap_out(vaddr_t v_addr, paddr_t p_addr, pid_t pid)
+int swap_reserve(vaddr_t v_addr, pid_t pid)
 {
     int i, j;
     int hash_ret = -1;
-    
-    v_addr &= PAGE_FRAME;
-    v_addr |= pid;
-
 
+    v_addr &= PAGE_FRAME;
     hash_ret = hash_swap(v_addr, pid);
 
+    spinlock_acquire(&swap_lock);
     for(i=0, j=hash_ret; i<HASH_SIZE; i++, j=(hash_ret+i)%HASH_SIZE) {
-        if(hash_table[j]==0 || hash_table[j]==0xFFFFFFFF) {
+        if(hash_table[j]==0 || hash_table[j]==SWAP_TOMBSTONE) {
             break;
         }
     }
 
-    
     if (i==HASH_SIZE)
     {
-        panic("Out of swap space");
+        // SWAPFILE pieno: decide il chiamante (pagina pulita o OOM killer)
+        spinlock_release(&swap_lock);
+        return -1;
     }
 
-    hash_table[j]=v_addr;
+    hash_table[j]=v_addr | pid | SWAP_BUSY;
+    spinlock_release(&swap_lock);
+    return j;
+}
+
+void swap_write_slot(int slot, paddr_t p_addr)
+{
+    KASSERT(SWAP_ENTRYBUSY(hash_table[slot]));
 
-    if (swap_write(j*PAGE_SIZE, PADDR_TO_KVADDR(p_addr)))
+    if (swap_write(slot*PAGE_SIZE, PADDR_TO_KVADDR(p_addr)))
     {
         panic("Error while writing on the swapfile.\n");
     }
+    spinlock_acquire(&swap_lock);
+    hash_table[slot] &= ~SWAP_BUSY;
+    spinlock_release(&swap_lock);
     vms_update(VMS_SWAPFILE_WRITES);
 }
+
+int swap_out(vaddr_t v_addr, paddr_t p_addr, pid_t pid)
+{
+    int slot;
+
+    slot = swap_reserve(v_addr, pid);
+    if (slot < 0)
+    {
+        return ENOSPC;
+    }
+    swap_write_slot(slot, p_addr);
+    return 0;
+}
+
+int swap_free_slots(void)
+{
+    int i, n = 0;
+
+    spinlock_acquire(&swap_lock);
+    for (i = 0; i < HASH_SIZE; i++)
+    {
+        if (hash_table[i] == 0 || hash_table[i] == SWAP_TOMBSTONE)
+        {
+            n++;
+        }
+    }
+    spinlock_release(&swap_lock);
+    return n;
+}
+
+int swap_discard_pid(pid_t pid)
+{
+    int i, n = 0;
+
+    spinlock_acquire(&swap_lock);
+    for (i = 0; i < HASH_SIZE; i++)
+    {
+        // uno slot ancora in scrittura resta: lo scarta l'uscita del processo
+        if (hash_table[i] != 0 && hash_table[i] != SWAP_TOMBSTONE &&
+            !SWAP_ENTRYBUSY(hash_table[i]) && SWAP_ENTRYPID(hash_table[i]) == pid)
+        {
+            hash_table[i] = SWAP_TOMBSTONE;
+            n++;
+        }
+    }
+    spinlock_release(&swap_lock);
+    return n;
+}
+
+void swap_usage(unsigned int *counts)
+{
+    int i;
+
+    spinlock_acquire(&swap_lock);
+    for (i = 0; i < HASH_SIZE; i++)
+    {
+        if (hash_table[i] != 0 && hash_table[i] != SWAP_TOMBSTONE)
+        {
+            counts[SWAP_ENTRYPID(hash_table[i])]++;
+        }
+    }
+    spinlock_release(&swap_lock);
+}
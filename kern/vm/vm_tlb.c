@@ -5,49 +5,379 @@
 #include <lib.h>
 #include <spl.h>
 #include <vmstats.h>
+#include <platform/maxcpus.h>
+#include <cpu.h>
+#include <current.h>
+#include <membar.h>
 
-int tlb_get_rr_victim(void)
+/*
+ * Per-CPU state of the fast-path TLB refill (mips_utlb_refill in
+ * exception-mips1.S), which depends on this exact layout.
+ */
+struct utlb_save {
+    uint32_t us_regs[6];        /* t0-t3, hi, lo of the interrupted code */
+    pid_t us_pid;               /* process running on the CPU, 0 if none */
+    uint32_t us_refills;        /* TLB misses served by the fast path */
+};
+struct utlb_save utlb_save[MAXCPUS];
+
+/* number of TLB misses served by the fast refill on all CPUs */
+unsigned int tlb_refill_count(void)
+{
+    unsigned int i, count = 0;
+
+    for (i = 0; i < MAXCPUS; i++)
+    {
+        count += utlb_save[i].us_refills;
+    }
+    return count;
+}
+
+/*
+ * Per-CPU TLB state. free is only a hint: the fast refill writes
+ * random entries without updating it, so a slot taken from it is
+ * checked before being used.
+ *
+ * The user entries of a process are only in the TLB of the CPU it was
+ * last activated on (ts_pid): tlb_activate flushes the TLB when a
+ * different process gets the CPU, and forgets the process on every
+ * other CPU. So a user page needs to be shot down on one CPU at most;
+ * kernel (kseg2) entries are global and can be in any TLB.
+ */
+struct tlb_state {
+    unsigned int ts_next;                         /* next round-robin victim */
+    uint32_t ts_free[(NUM_TLB + 31) / 32];        /* entries known to be invalid */
+    volatile pid_t ts_pid;                        /* process whose entries may be in the TLB, 0 if none */
+    struct cpu *ts_cpu;                           /* NULL until the CPU uses its TLB */
+};
+static struct tlb_state tlb_state[MAXCPUS];
+
+/* TLB state of this CPU (interrupts off) */
+static struct tlb_state *tlb_mine(void)
+{
+    struct tlb_state *ts = &tlb_state[curcpu->c_number];
+
+    ts->ts_cpu = curcpu->c_self;
+    return ts;
+}
+
+#define TLB_FREE_SET(ts, i)   ((ts)->ts_free[(i) / 32] |= (uint32_t)1 << ((i) % 32))
+#define TLB_FREE_CLEAR(ts, i) ((ts)->ts_free[(i) / 32] &= ~((uint32_t)1 << ((i) % 32)))
+
+/* returns an invalid entry from the free hint, -1 if there is none (interrupts off) */
+static int tlb_get_free(struct tlb_state *ts)
+{
+    unsigned int w;
+    int i;
+    uint32_t ehi, elo;
+
+    for (w = 0; w < (NUM_TLB + 31) / 32; w++)
+    {
+        while (ts->ts_free[w] != 0)
+        {
+            for (i = 0; !(ts->ts_free[w] & ((uint32_t)1 << i)); i++)
+                ;
+            i += w * 32;
+            TLB_FREE_CLEAR(ts, i);
+            tlb_read(&ehi, &elo, i);
+            if (!(elo & TLBLO_VALID))
+            {
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
+/*
+ * Round-robin victim, skipping the entries of the pages next to vaddr:
+ * they are likely to be used again soon (interrupts off).
+ */
+static int tlb_get_rr_victim(struct tlb_state *ts, vaddr_t vaddr)
 {
-    int victim;
-    static unsigned int next_victim = 0;
-    victim = next_victim;
-    next_victim = (next_victim + 1) % NUM_TLB;
+    int victim, n;
+    uint32_t ehi, elo;
+    vaddr_t page;
+
+    for (n = 0; n < NUM_TLB; n++)
+    {
+        victim = ts->ts_next;
+        ts->ts_next = (ts->ts_next + 1) % NUM_TLB;
+        tlb_read(&ehi, &elo, victim);
+        page = ehi & TLBHI_VPAGE;
+        if (!(elo & TLBLO_VALID) || (page != vaddr - PAGE_SIZE && page != vaddr + PAGE_SIZE))
+        {
+            return victim;
+        }
+    }
     return victim;
 }
 
-void tlb_insert(vaddr_t vaddr, paddr_t paddr){
+/* map vaddr to paddr in the TLB, writable only if dirty is set */
+void tlb_insert(vaddr_t vaddr, paddr_t paddr, int dirty){
     int spl, i;
     uint32_t ehi, elo;
+    struct tlb_state *ts;
 
 	KASSERT((vaddr & PAGE_FRAME)==vaddr);
 	KASSERT((paddr & PAGE_FRAME)==paddr);
 
     spl = splhigh();
+	ts = tlb_mine();
 
-	i = tlb_get_rr_victim();
-	tlb_read(&ehi, &elo, i);
-	if((elo & TLBLO_VALID) != TLBLO_VALID)
+	i = tlb_get_free(ts);
+	if (i >= 0)
 	{
 		vms_update(VMS_FAULTS_FREE);
 	}
 	else
 	{
-		vms_update(VMS_FAULTS_REPLACE);
+		i = tlb_get_rr_victim(ts, vaddr);
+		tlb_read(&ehi, &elo, i);
+		if((elo & TLBLO_VALID) != TLBLO_VALID)
+		{
+			vms_update(VMS_FAULTS_FREE);
+		}
+		else
+		{
+			vms_update(VMS_FAULTS_REPLACE);
+		}
 	}
 
 	ehi = vaddr;
-	elo = paddr | TLBLO_DIRTY | TLBLO_VALID;
+	elo = paddr | TLBLO_VALID;
+	if (dirty)
+		elo |= TLBLO_DIRTY;
 	DEBUG(DB_VM, "tlb_manage: 0x%x -> 0x%x\n", vaddr, paddr);
 	tlb_write(ehi, elo, i);
 	splx(spl);
 	return;
 }
 
-void tlb_invalidate(void){
-	int i;
+/* invalidate the whole TLB of this CPU without counting it in the statistics */
+void tlb_flush(void){
+	int i, spl;
+	struct tlb_state *ts;
+
+	spl = splhigh();
+	ts = tlb_mine();
 	for (i = 0; i < NUM_TLB; i++)
 	{
 		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		TLB_FREE_SET(ts, i);
 	}
+	splx(spl);
+}
+
+void tlb_invalidate(void){
+	tlb_flush();
 	vms_update(VMS_INVALIDATE);
-}
\ No newline at end of file
+}
+
+/* drop the TLB entry of vaddr, if any */
+void tlb_invalidate_vaddr(vaddr_t vaddr){
+	int i, spl;
+
+	spl = splhigh();
+	i = tlb_probe(vaddr, 0);
+	if (i >= 0)
+	{
+		tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+		TLB_FREE_SET(&tlb_state[curcpu->c_number], i);
+	}
+	splx(spl);
+}
+
+/* drop the TLB entries of the pages in [start, end) */
+void tlb_invalidate_range(vaddr_t start, vaddr_t end){
+	int i, spl;
+	uint32_t ehi, elo;
+	struct tlb_state *ts;
+
+	spl = splhigh();
+	ts = &tlb_state[curcpu->c_number];
+	for (i = 0; i < NUM_TLB; i++)
+	{
+		tlb_read(&ehi, &elo, i);
+		if ((elo & TLBLO_VALID) && (ehi & TLBHI_VPAGE) >= start && (ehi & TLBHI_VPAGE) < end)
+		{
+			tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+			TLB_FREE_SET(ts, i);
+		}
+	}
+	splx(spl);
+}
+
+/* map a kseg2 page: the entry is global, valid for every process */
+void tlb_insert_kernel(vaddr_t vaddr, paddr_t paddr){
+	int spl;
+
+	spl = splhigh();
+	(void)tlb_mine();
+	tlb_random(vaddr, paddr | TLBLO_DIRTY | TLBLO_VALID | TLBLO_GLOBAL);
+	splx(spl);
+}
+
+/*
+ * Switch this CPU to process pid (0 for a kernel thread, which leaves
+ * the TLB alone). The TLB is flushed only if it may hold entries of
+ * another process.
+ */
+void tlb_activate(pid_t pid){
+	int spl;
+	unsigned int i;
+	struct tlb_state *ts;
+
+	KASSERT(sizeof(struct utlb_save) == 32);
+
+	spl = splhigh();
+	ts = tlb_mine();
+	utlb_save[curcpu->c_number].us_pid = pid;
+	if (pid != 0 && ts->ts_pid != pid)
+	{
+		/* entries left on the CPUs pid ran on before are stale from now on */
+		for (i = 0; i < MAXCPUS; i++)
+		{
+			if (tlb_state[i].ts_pid == pid)
+			{
+				tlb_state[i].ts_pid = 0;
+			}
+		}
+		tlb_flush();
+		membar_any_any();
+		ts->ts_pid = pid;
+	}
+	splx(spl);
+}
+
+/* pid is gone: no CPU may reuse its entries for a new process with the same pid */
+void tlb_forget(pid_t pid){
+	unsigned int i;
+
+	for (i = 0; i < MAXCPUS; i++)
+	{
+		if (tlb_state[i].ts_pid == pid)
+		{
+			tlb_state[i].ts_pid = 0;
+		}
+	}
+}
+
+/* start a batch of invalidations of the pages of process pid (0 = kernel pages) */
+void tlb_batch_init(struct tlb_batch *tb, pid_t pid){
+	tb->tb_pid = pid;
+	tb->tb_n = 0;
+}
+
+/* add a page to the batch; past TLBSHOOTDOWN_MAX pages the batch becomes a full flush */
+void tlb_batch_add(struct tlb_batch *tb, vaddr_t vaddr){
+	if (tb->tb_n < TLBSHOOTDOWN_MAX)
+	{
+		tb->tb_ts[tb->tb_n].ts_vaddr = vaddr & PAGE_FRAME;
+		tb->tb_ts[tb->tb_n].ts_pid = tb->tb_pid;
+	}
+	if (tb->tb_n <= TLBSHOOTDOWN_MAX)
+	{
+		tb->tb_n++;
+	}
+}
+
+/* invalidate the pages of the batch here (interrupts off) */
+static void tlb_batch_local(const struct tlb_batch *tb){
+	unsigned int i;
+
+	if (tb->tb_n > TLBSHOOTDOWN_MAX)
+	{
+		tlb_invalidate();
+		return;
+	}
+	for (i = 0; i < tb->tb_n; i++)
+	{
+		tlb_invalidate_vaddr(tb->tb_ts[i].ts_vaddr);
+	}
+}
+
+/*
+ * Invalidate the pages of the batch on every CPU that may have them,
+ * and wait until all of them have done it: after this, no TLB maps
+ * the old frames. One IPI per CPU, whatever the size of the batch.
+ * Must be called with no spinlock held.
+ */
+void tlb_batch_flush(struct tlb_batch *tb){
+	struct cpu *target[MAXCPUS];
+	unsigned int ticket[MAXCPUS];
+	unsigned int i, me;
+	int spl;
+
+	if (tb->tb_n == 0)
+	{
+		return;
+	}
+
+	spl = splhigh();
+	me = curcpu->c_number;
+	if (tb->tb_pid == 0 || tlb_state[me].ts_pid == tb->tb_pid)
+	{
+		tlb_batch_local(tb);
+	}
+	for (i = 0; i < MAXCPUS; i++)
+	{
+		target[i] = NULL;
+		if (i == me || tlb_state[i].ts_cpu == NULL)
+		{
+			continue;
+		}
+		if (tb->tb_pid != 0 && tlb_state[i].ts_pid != tb->tb_pid)
+		{
+			continue;
+		}
+		target[i] = tlb_state[i].ts_cpu;
+		ticket[i] = ipi_tlbshootdown_batch(target[i],
+			tb->tb_n > TLBSHOOTDOWN_MAX ? NULL : tb->tb_ts,
+			tb->tb_n);
+		vms_update(VMS_SHOOTDOWNS);
+	}
+	splx(spl);
+
+	for (i = 0; i < MAXCPUS; i++)
+	{
+		if (target[i] != NULL)
+		{
+			ipi_tlbshootdown_wait(target[i], ticket[i]);
+		}
+	}
+	tb->tb_n = 0;
+}
+
+/* invalidate the page vaddr of process pid on every CPU (no spinlock held) */
+void tlb_shootdown(vaddr_t vaddr, pid_t pid){
+	struct tlb_batch tb;
+
+	tlb_batch_init(&tb, pid);
+	tlb_batch_add(&tb, vaddr);
+	tlb_batch_flush(&tb);
+}
+
+/* flush the TLB of every CPU (no spinlock held) */
+void tlb_shootdown_all(void){
+	struct tlb_batch tb;
+
+	tlb_batch_init(&tb, 0);
+	tb.tb_n = TLBSHOOTDOWN_MAX + 1;
+	tlb_batch_flush(&tb);
+}
+
+/* shootdown request from another CPU (interrupts off) */
+void vm_tlbshootdown(const struct tlbshootdown *ts){
+	/* the process moved to another CPU since the request was sent: its entries here are already stale */
+	if (ts->ts_pid != 0 && ts->ts_pid != tlb_state[curcpu->c_number].ts_pid)
+	{
+		return;
+	}
+	tlb_invalidate_vaddr(ts->ts_vaddr);
+}
+
+/* request to flush the whole TLB from another CPU (interrupts off) */
+void vm_tlbshootdown_all(void){
+	tlb_invalidate();
+}
@@ -0,0 +1,206 @@
+#include <vmalloc.h>
+#include <coremap.h>
+#include <synch.h>
+#include <pt.h>
+#include <vm_tlb.h>
+
+/*
+ * Mapped kernel memory.
+ *
+ * Multi-page kernel allocations that cannot be satisfied with
+ * contiguous frames are backed by single frames and mapped into a
+ * window of kseg2. Every page of the window has an entry in kseg2_map
+ * holding the physical frame (0 if unmapped); the first entry of each
+ * allocation also keeps the length of the run (in pages) in the low
+ * bits, which are always zero in a frame address. The pages of an
+ * allocation still being filled hold K2_RESERVED, so that the window
+ * is taken under kseg2_lock and the frames are found without it.
+ */
+
+#define K2_PADDR(entry)  ((entry) & PAGE_FRAME)
+#define K2_NPAGES(entry) ((entry) & ~PAGE_FRAME)
+#define K2_MAXPAGES      (~PAGE_FRAME)
+#define K2_RESERVED      1
+
+static paddr_t *kseg2_map = NULL;
+static unsigned int kseg2_npages = 0;
+static struct lock *kseg2_lock = NULL;
+
+/* bootstrap for the kseg2 allocator (must be called before the coremap is active) */
+void vmalloc_bootstrap(unsigned int nframes)
+{
+	unsigned int i;
+
+	/* twice the RAM size, so that the window does not fragment before memory does */
+	kseg2_npages = 2 * nframes;
+	kseg2_map = kmalloc(kseg2_npages * sizeof(paddr_t));
+	kseg2_lock = lock_create("kseg2");
+	if (kseg2_map == NULL || kseg2_lock == NULL)
+	{
+		panic("Error allocating kseg2 map: out of memory.");
+	}
+	for (i = 0; i < kseg2_npages; i++)
+	{
+		kseg2_map[i] = 0;
+	}
+}
+
+/* returns the index of the first run of npages unmapped pages in the window, -1 if none */
+static int kseg2_find_run(unsigned int npages)
+{
+	unsigned int i, count;
+
+	for (i = 0, count = 0; i < kseg2_npages; i++)
+	{
+		if (kseg2_map[i] != 0)
+		{
+			count = 0;
+			continue;
+		}
+		count++;
+		if (count == npages)
+		{
+			return i + 1 - npages;
+		}
+	}
+	return -1;
+}
+
+/* unmap and free the frames of the pages [first, first + npages) of the window, which stays taken (no lock held) */
+static void kseg2_unmap(unsigned int first, unsigned int npages)
+{
+	unsigned int i;
+	paddr_t paddr;
+	struct tlb_batch tb;
+
+	/* the entries are global and may be in any TLB: drop them everywhere before freeing the frames */
+	tlb_batch_init(&tb, 0);
+	for (i = first; i < first + npages; i++)
+	{
+		if (K2_PADDR(kseg2_map[i]) != 0)
+		{
+			tlb_batch_add(&tb, KSEG2_BASE + i * PAGE_SIZE);
+		}
+	}
+	tlb_batch_flush(&tb);
+
+	/* a frame that goes back to the page table may move it: not under kseg2_lock */
+	for (i = first; i < first + npages; i++)
+	{
+		paddr = K2_PADDR(kseg2_map[i]);
+		if (paddr != 0)
+		{
+			pt_freekpages(paddr / PAGE_SIZE);
+		}
+	}
+}
+
+/* give the pages [first, first + npages) back to the window */
+static void kseg2_release(unsigned int first, unsigned int npages)
+{
+	unsigned int i;
+
+	lock_acquire(kseg2_lock);
+	for (i = first; i < first + npages; i++)
+	{
+		kseg2_map[i] = 0;
+	}
+	lock_release(kseg2_lock);
+}
+
+/* allocate npages of kernel memory backed by frames that need not be contiguous */
+vaddr_t vmalloc(unsigned int npages)
+{
+	int first;
+	unsigned int i;
+	paddr_t paddr;
+
+	KASSERT(kseg2_map != NULL);
+	if (npages == 0 || npages > K2_MAXPAGES)
+	{
+		return 0;
+	}
+
+	lock_acquire(kseg2_lock);
+	first = kseg2_find_run(npages);
+	if (first < 0)
+	{
+		lock_release(kseg2_lock);
+		return 0;
+	}
+	for (i = first; i < first + npages; i++)
+	{
+		kseg2_map[i] = K2_RESERVED;
+	}
+	lock_release(kseg2_lock);
+
+	/* nobody else uses the reserved pages: they are filled without kseg2_lock, a frame at a time */
+	for (i = first; i < first + npages; i++)
+	{
+		/* frames already free first: they cost nothing */
+		paddr = pt_getfreekpages(1);
+		if (paddr == 0)
+		{
+			/* then a cluster of the page table, whose other frames serve the next pages */
+			paddr = pt_getkpages(1);
+		}
+		if (paddr == 0)
+		{
+			kseg2_unmap(first, i - first);
+			kseg2_release(first, npages);
+			return 0;
+		}
+		kseg2_map[i] = paddr;
+	}
+	lock_acquire(kseg2_lock);
+	kseg2_map[first] |= npages;
+	lock_release(kseg2_lock);
+
+	DEBUG(DB_VM, "vmalloc: %u pages at 0x%x\n", npages, KSEG2_BASE + first * PAGE_SIZE);
+	return KSEG2_BASE + first * PAGE_SIZE;
+}
+
+/* free a region returned by vmalloc */
+void vfree(vaddr_t vaddr)
+{
+	unsigned int first, npages;
+
+	KASSERT(IS_KSEG2(vaddr));
+	KASSERT((vaddr & PAGE_FRAME) == vaddr);
+
+	first = (vaddr - KSEG2_BASE) / PAGE_SIZE;
+	KASSERT(first < kseg2_npages);
+
+	lock_acquire(kseg2_lock);
+	npages = K2_NPAGES(kseg2_map[first]);
+	lock_release(kseg2_lock);
+	if (npages == 0 || K2_PADDR(kseg2_map[first]) == 0)
+	{
+		panic("vfree: 0x%x is not the start of a kseg2 allocation\n", vaddr);
+	}
+	kseg2_unmap(first, npages);
+	kseg2_release(first, npages);
+}
+
+/* reload the TLB entry of a kseg2 page (called by vm_fault) */
+int vmalloc_fault(vaddr_t vaddr)
+{
+	unsigned int page;
+	paddr_t paddr;
+
+	vaddr &= PAGE_FRAME;
+	page = (vaddr - KSEG2_BASE) / PAGE_SIZE;
+	if (page >= kseg2_npages)
+	{
+		return EFAULT;
+	}
+	/* no lock: a mapping never changes while its owner is using it */
+	paddr = K2_PADDR(kseg2_map[page]);
+	if (paddr == 0)
+	{
+		return EFAULT;
+	}
+
+	tlb_insert_kernel(vaddr, paddr);
+	return 0;
+}
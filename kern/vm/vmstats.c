@@ -1,70 +1,150 @@
+#include <types.h>
 #include <vmstats.h>
+#include <vm_tlb.h>
+#include <spl.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <limits.h>
+#include <platform/maxcpus.h>
+#include <opt-proc_manage.h>
 
-unsigned int vms_faults = 0;
-unsigned int vms_faults_free = 0;
-unsigned int vms_faults_replace = 0;
-unsigned int vms_invalidate = 0;
-unsigned int vms_reload = 0;
-unsigned int vms_faults_zeroed = 0;
-unsigned int vms_faults_disk = 0;
-unsigned int vms_faults_elf = 0;
-unsigned int vms_faults_swapfile = 0;
-unsigned int vms_swapfile_writes = 0;
+/*
+ * Every CPU counts in its own row, with interrupts off, so there is no
+ * lock and no lost update; the rows are added up when the counters
+ * are read. The events of a process are also counted in its struct
+ * proc, which only its own thread writes.
+ */
+static unsigned int vms_counters[MAXCPUS][VMS_NSTATS];
+
+static const char *vms_names[VMS_NSTATS] = {
+    "faults", "free", "replace", "inval", "reload", "zeroed", "disk",
+    "elf", "swapin", "swapout", "zeropg", "mmap", "ahead", "shootdn", "evict", "oomkill",
+};
 
 void vms_update(unsigned char code)
 {
-    switch(code){
-        case VMS_FAULTS:
-        vms_faults++;
-        break;                  
-        case VMS_FAULTS_FREE:
-        vms_faults_free++;
-        break;        
-        case VMS_FAULTS_REPLACE:
-        vms_faults_replace++;
-        break;  
-        case VMS_INVALIDATE:
-        vms_invalidate++;
-        break;          
-        case VMS_RELOAD:
-        vms_reload++;
-        break;                  
-        case VMS_FAULTS_ZEROED:
-        vms_faults_zeroed++;
-        break;    
-        case VMS_FAULTS_DISK:
-        vms_faults_disk++;
-        break;        
-        case VMS_FAULTS_ELF:
-        vms_faults_elf++;
-        break;          
-        case VMS_FAULTS_SWAPFILE:
-        vms_faults_swapfile++;
-        break;
-        case VMS_SWAPFILE_WRITES:
-        vms_swapfile_writes++;
-        break;
-        default:
+    int spl;
+
+    if (code >= VMS_NSTATS)
+    {
         kprintf("Unknown stat code: %d\n", code);
+        return;
+    }
+    spl = splhigh();
+    vms_counters[curcpu->c_number][code]++;
+    // shootdowns handled in an interrupt are not done on behalf of the interrupted process
+    if (!curthread->t_in_interrupt && curproc != NULL && curproc != kproc)
+    {
+        curproc->p_vmstats[code]++;
+    }
+    splx(spl);
+}
+
+/* copy the system-wide counters (the sum of the per-CPU ones) into counts[VMS_NSTATS] */
+void vms_get(unsigned int *counts)
+{
+    unsigned int i, code;
+
+    for (code = 0; code < VMS_NSTATS; code++)
+    {
+        counts[code] = 0;
+        for (i = 0; i < MAXCPUS; i++)
+        {
+            counts[code] += vms_counters[i][code];
+        }
     }
 }
 
 void vms_print(void)
 {
-    kprintf("[vmstats] TLB Faults: %u\n", vms_faults);
-    kprintf("[vmstats] TLB Faults with Free: %u\n", vms_faults_free);
-    kprintf("[vmstats] TLB Faults with Replace: %u\n", vms_faults_replace);
-    if(vms_faults_free + vms_faults_replace != vms_faults)
+    unsigned int c[VMS_NSTATS];
+
+    vms_get(c);
+    kprintf("[vmstats] TLB Faults: %u\n", c[VMS_FAULTS]);
+    kprintf("[vmstats] TLB Faults with Free: %u\n", c[VMS_FAULTS_FREE]);
+    kprintf("[vmstats] TLB Faults with Replace: %u\n", c[VMS_FAULTS_REPLACE]);
+    if(c[VMS_FAULTS_FREE] + c[VMS_FAULTS_REPLACE] != c[VMS_FAULTS])
         kprintf("[vmstats] WARNING: \"TLB Faults with Free\" and \"TLB Faults with Replace\" should be equal to \"TLB Faults\"!\n");
-    kprintf("[vmstats] TLB Invalidations: %u\n", vms_invalidate);
-    kprintf("[vmstats] TLB Reloads: %u\n", vms_reload);
-    kprintf("[vmstats] Page Faults (Zeroed) : %u\n", vms_faults_zeroed);
-    kprintf("[vmstats] Page Faults (Disk): %u\n", vms_faults_disk);
-    if(vms_reload + vms_faults_zeroed + vms_faults_disk != vms_faults)
+    kprintf("[vmstats] TLB Invalidations: %u\n", c[VMS_INVALIDATE]);
+    kprintf("[vmstats] TLB Reloads: %u\n", c[VMS_RELOAD]);
+    kprintf("[vmstats] Fast TLB Refills (not counted as faults): %u\n", tlb_refill_count());
+    kprintf("[vmstats] Page Faults (Zeroed) : %u\n", c[VMS_FAULTS_ZEROED]);
+    kprintf("[vmstats] Zero Page Mappings: %u\n", c[VMS_ZEROPAGE_MAPS]);
+    kprintf("[vmstats] Page Faults (Disk): %u\n", c[VMS_FAULTS_DISK]);
+    if(c[VMS_RELOAD] + c[VMS_FAULTS_ZEROED] + c[VMS_FAULTS_DISK] != c[VMS_FAULTS])
         kprintf("[vmstats] WARNING: \"TLB Reloads\", \"Page Faults (Zeroed)\" and \"Page Faults (Disk)\" should be equal to \"TLB Faults\"!\n");
-    kprintf("[vmstats] Page Faults from ELF: %u\n", vms_faults_elf);
-    kprintf("[vmstats] Page Faults from Swapfile: %u\n", vms_faults_swapfile);
-    if(vms_faults_elf + vms_faults_swapfile != vms_faults_disk)
-        kprintf("[vmstats] WARNING: \"Page Faults from ELF\" and \"Page Faults from Swapfile\" should be equal to \"Page Faults (Disk)\"!\n");
-    kprintf("[vmstats] Swapfile Writes: %u\n", vms_swapfile_writes);
-}
\ No newline at end of file
+    kprintf("[vmstats] Page Faults from ELF: %u\n", c[VMS_FAULTS_ELF]);
+    kprintf("[vmstats] Page Faults from Swapfile: %u\n", c[VMS_FAULTS_SWAPFILE]);
+    kprintf("[vmstats] Page Faults from Mapped Files: %u\n", c[VMS_FAULTS_MMAP]);
+    if(c[VMS_FAULTS_ELF] + c[VMS_FAULTS_SWAPFILE] + c[VMS_FAULTS_MMAP] != c[VMS_FAULTS_DISK])
+        kprintf("[vmstats] WARNING: \"Page Faults from ELF\", \"Page Faults from Swapfile\" and \"Page Faults from Mapped Files\" should be equal to \"Page Faults (Disk)\"!\n");
+    kprintf("[vmstats] Read-ahead Pages: %u\n", c[VMS_READAHEAD]);
+    kprintf("[vmstats] Page Evictions: %u\n", c[VMS_EVICTIONS]);
+    kprintf("[vmstats] Swapfile Writes: %u\n", c[VMS_SWAPFILE_WRITES]);
+    kprintf("[vmstats] TLB Shootdowns Sent: %u\n", c[VMS_SHOOTDOWNS]);
+    kprintf("[vmstats] OOM Kills: %u\n", c[VMS_OOMKILLS]);
+}
+
+/* print one line of counters, with the header first if title is set */
+static void vms_print_row(const char *title, const char *label, const unsigned int *counts)
+{
+    unsigned int code;
+
+    if (title != NULL)
+    {
+        kprintf("%-12s", title);
+        for (code = 0; code < VMS_NSTATS; code++)
+        {
+            kprintf(" %7s", vms_names[code]);
+        }
+        kprintf("\n");
+    }
+    kprintf("%-12s", label);
+    for (code = 0; code < VMS_NSTATS; code++)
+    {
+        kprintf(" %7u", counts[code]);
+    }
+    kprintf("\n");
+}
+
+/* counters of each CPU and of each process (menu command) */
+void vms_print_detail(void)
+{
+    unsigned int i, counts[VMS_NSTATS];
+    char label[16], name[12];
+    int first;
+    pid_t pid;
+
+    vms_get(counts);
+    vms_print_row("", "total", counts);
+    for (i = 0; i < MAXCPUS; i++)
+    {
+        /* vms_counters only grows: a CPU that never faulted has an all-zero row */
+        if (vms_counters[i][VMS_FAULTS] == 0 && vms_counters[i][VMS_INVALIDATE] == 0)
+        {
+            continue;
+        }
+        snprintf(label, sizeof(label), "cpu%u", i);
+        vms_print_row(NULL, label, vms_counters[i]);
+    }
+
+#if OPT_PROC_MANAGE
+    first = 1;
+    for (pid = PID_MIN; pid < PID_MAX; pid++)
+    {
+        if (proc_vmstats(pid, counts, name, sizeof(name)))
+        {
+            continue;
+        }
+        snprintf(label, sizeof(label), "%d %s", pid, name);
+        vms_print_row(first ? "pid" : NULL, label, counts);
+        first = 0;
+    }
+#else
+    (void)first;
+    (void)pid;
+    (void)name;
+#endif
+}
@@ -0,0 +1,126 @@
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <clock.h>
+#include <vmtrace.h>
+#include <platform/maxcpus.h>
+
+/*
+ * Page fault latency. Like the statistics, each CPU writes only its
+ * own histograms and trace ring (with interrupts off), and print adds
+ * them up. The ring keeps the last VMT_RINGSIZE faults of the CPU.
+ */
+
+struct vmt_entry {
+    pid_t e_pid;
+    vaddr_t e_vaddr;
+    uint32_t e_ns;              /* duration (saturated) */
+    uint32_t e_type;            /* VMT_* */
+};
+
+struct vmt_cpu {
+    uint32_t c_hist[VMT_NTYPES][VMT_NBUCKETS];
+    uint32_t c_total_us[VMT_NTYPES];            /* total time, for the average */
+    struct vmt_entry c_ring[VMT_RINGSIZE];
+    unsigned int c_next;                        /* number of faults recorded (next slot modulo the size) */
+};
+static struct vmt_cpu vmt_cpus[MAXCPUS];
+
+static const char *vmt_names[VMT_NTYPES] = {
+    "reload", "zero", "elf", "mmap", "swapin", "evict",
+};
+
+/* record a fault of type path on vaddr of process pid, started at start */
+void vmt_record(int path, pid_t pid, vaddr_t vaddr, const struct timespec *start)
+{
+    struct timespec now, delta;
+    struct vmt_cpu *c;
+    struct vmt_entry *e;
+    uint32_t ns;
+    unsigned int b;
+    int spl;
+
+    KASSERT(path >= 0 && path < VMT_NTYPES);
+    gettime(&now);
+    timespec_sub(&now, start, &delta);
+    ns = delta.tv_sec >= 4 ? 0xffffffff : (uint32_t)delta.tv_sec * 1000000000 + delta.tv_nsec;
+    for (b = 0; b < VMT_NBUCKETS - 1 && (ns >> (b + 1)) != 0; b++)
+        ;
+
+    spl = splhigh();
+    c = &vmt_cpus[curcpu->c_number];
+    c->c_hist[path][b]++;
+    c->c_total_us[path] += ns / 1000;
+    e = &c->c_ring[c->c_next % VMT_RINGSIZE];
+    e->e_pid = pid;
+    e->e_vaddr = vaddr;
+    e->e_ns = ns;
+    e->e_type = path;
+    c->c_next++;
+    splx(spl);
+}
+
+/* clear histograms and trace */
+void vmt_reset(void)
+{
+    bzero(vmt_cpus, sizeof(vmt_cpus));
+}
+
+/* print the histograms and the last faults of each CPU (menu command) */
+void vmt_print(void)
+{
+    uint32_t count[VMT_NBUCKETS], n, total_us;
+    unsigned int i, b, t, k, first;
+    struct vmt_entry *e;
+
+    kprintf("fault latency (ns, log2 buckets):\n");
+    for (t = 0; t < VMT_NTYPES; t++)
+    {
+        n = total_us = 0;
+        for (b = 0; b < VMT_NBUCKETS; b++)
+        {
+            count[b] = 0;
+            for (i = 0; i < MAXCPUS; i++)
+            {
+                count[b] += vmt_cpus[i].c_hist[t][b];
+            }
+            n += count[b];
+        }
+        if (n == 0)
+        {
+            continue;
+        }
+        for (i = 0; i < MAXCPUS; i++)
+        {
+            total_us += vmt_cpus[i].c_total_us[t];
+        }
+        kprintf("%-7s %u faults, avg %u us\n", vmt_names[t], n, total_us / n);
+        for (b = 0; b < VMT_NBUCKETS; b++)
+        {
+            if (count[b] != 0)
+            {
+                kprintf("  >= %10u: %u\n", (uint32_t)1 << b, count[b]);
+            }
+        }
+    }
+
+    for (i = 0; i < MAXCPUS; i++)
+    {
+        if (vmt_cpus[i].c_next == 0)
+        {
+            continue;
+        }
+        kprintf("cpu%u: last faults (oldest first)\n", i);
+        /* the ring is read while it may still be written: a line can be mixed up, never out of bounds */
+        k = vmt_cpus[i].c_next;
+        first = k > VMT_RINGSIZE ? k - VMT_RINGSIZE : 0;
+        for (; first < k; first++)
+        {
+            e = &vmt_cpus[i].c_ring[first % VMT_RINGSIZE];
+            kprintf("  pid %3d 0x%08x %-7s %u ns\n", e->e_pid, e->e_vaddr,
+                    vmt_names[e->e_type < VMT_NTYPES ? e->e_type : 0], e->e_ns);
+        }
+    }
+}
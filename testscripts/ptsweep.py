@@ -0,0 +1,122 @@
+#!/usr/pkg/bin/python2.7
+# ptsweep.py - sweep the page table associativity and hash function
+# usage: auto/ptsweep.py [options] [testbin ...]
+# options:
+#    --conf=sys161.conf	Use alternate sys161 config
+#    --ram=N		Force RAM size (default from sys161 config)
+#    --cpus=N		Force number of cpus (default from sys161 config)
+#    --timeout=N	Global timeout for each run, in seconds (default 600)
+#    --kernel=KERNEL	Choose kernel to run (default "kernel")
+#    --assoc=LIST	Comma-separated cluster sizes (default 2,4,8,16)
+#    --hash=LIST	Comma-separated hash functions (default mod,mult,xor)
+#
+# Boots the kernel once for every combination of cluster size, hash
+# function and test program, passing "ptconf ASSOC HASH" in the boot
+# arguments, and prints a table with the TLB faults, evictions and
+# swapfile writes of the run and the evictions the page table took
+# while other clusters still had free frames (see "ptstat").
+#
+# The test programs are run from /testbin; the default set is the VM
+# stress tests. Use a small --ram so that the runs actually page.
+#
+
+import re
+import sys
+from optparse import OptionParser
+
+import runtest
+
+try:
+	from StringIO import StringIO
+except ImportError:
+	from io import StringIO
+
+g_conf = None
+g_cpus = None
+g_kernel = None
+g_ram = None
+g_timeout = 600
+g_assoc = [2, 4, 8, 16]
+g_hash = ["mod", "mult", "xor"]
+g_tests = ["matmult", "sort", "huge", "parallelvm", "mmapcat", "tlbthrash"]
+
+# values picked out of the output of a run
+patterns = [
+	("faults", re.compile(r"\[vmstats\] TLB Faults: (\d+)")),
+	("evict", re.compile(r"\[vmstats\] Page Evictions: (\d+)")),
+	("swapw", re.compile(r"\[vmstats\] Swapfile Writes: (\d+)")),
+	("conflicts", re.compile(r"pt\.conflicts=(\d+)")),
+]
+
+def getargs():
+	global g_conf, g_cpus, g_kernel, g_ram, g_timeout
+	global g_assoc, g_hash, g_tests
+
+	p = OptionParser()
+	p.add_option("-c", "--conf", dest="conf")
+	p.add_option("-j", "--cpus", dest="cpus")
+	p.add_option("-k", "--kernel", dest="kernel")
+	p.add_option("-r", "--ram", dest="ram")
+	p.add_option("-t", "--timeout", dest="timeout")
+	p.add_option("-a", "--assoc", dest="assoc")
+	p.add_option("-H", "--hash", dest="hash")
+
+	(options, args) = p.parse_args()
+	if options.conf is not None:
+		g_conf = options.conf
+	if options.cpus is not None:
+		g_cpus = int(options.cpus)
+	if options.kernel is not None:
+		g_kernel = options.kernel
+	if options.ram is not None:
+		g_ram = options.ram
+	if options.timeout is not None:
+		g_timeout = int(options.timeout)
+	if options.assoc is not None:
+		g_assoc = [int(a) for a in options.assoc.split(",")]
+	if options.hash is not None:
+		g_hash = options.hash.split(",")
+	if len(args) > 0:
+		g_tests = args
+# end getargs
+
+#
+# Run one test with one configuration; returns a dict with the values
+# in patterns (missing ones are None) and the failure message, if any.
+#
+def runone(test, assoc, hashname):
+	out = StringIO()
+	msg = runtest.run("p /testbin/%s; ptstat -d; q" % test, out,
+		conf=g_conf, ram=g_ram, cpus=g_cpus,
+		progress=None, timeout=g_timeout,
+		kernel=g_kernel,
+		kernelargs="ptconf %d %s" % (assoc, hashname))
+	text = out.getvalue()
+	result = {}
+	for (name, pat) in patterns:
+		m = pat.search(text)
+		result[name] = int(m.group(1)) if m is not None else None
+	result["msg"] = msg
+	return result
+# end runone
+
+def show(value):
+	if value is None:
+		return "-"
+	return "%d" % value
+
+getargs()
+sys.stdout.write("%-12s %5s %5s %9s %9s %9s %9s  %s\n" %
+	("test", "assoc", "hash", "faults", "evict", "swapw",
+	 "conflicts", "status"))
+for test in g_tests:
+	for assoc in g_assoc:
+		for hashname in g_hash:
+			r = runone(test, assoc, hashname)
+			sys.stdout.write("%-12s %5d %5s %9s %9s %9s %9s  %s\n" %
+				(test, assoc, hashname, show(r["faults"]),
+				 show(r["evict"]), show(r["swapw"]),
+				 show(r["conflicts"]),
+				 "ok" if r["msg"] is None else r["msg"]))
+			sys.stdout.flush()
+exit(0)
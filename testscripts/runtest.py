@@ -10,7 +10,8 @@
 #               doom=None,		default is no doom counter
 #               progress=30,		default is 30 seconds
 #               timeout=300,		default is 300 seconds
-#               kernel=None)		default is "kernel"
+#               kernel=None,		default is "kernel"
+#               kernelargs=None)	default is no boot arguments
 #
 # Returns None on success or a (string) message if something apparently
 # went wrong in the middle. (XXX: should it throw exceptions instead?)
@@ -64,6 +65,11 @@
 # I haven't tested it. I don't recommend trying: it is your defense
 # against test runs hanging forever.
 #
+# * The kernelargs argument is a string passed to the kernel as its
+# boot arguments, i.e. menu commands run before the first prompt.
+# Some kernel settings (e.g. the page table "ptconf") can only be
+# chosen there.
+#
 # Note that no-debugger unattended mode (sys161 -X) is always used.
 # The purpose of this script is specifically to support unattended
 # test runs...
@@ -124,7 +130,7 @@ def run(testcommands, outputfile,
 		conf=None, ram=None, cpus=None,
 		doom=None,
 		progress=30, timeout=300,
-		kernel=None):
+		kernel=None, kernelargs=None):
 	if menuprompt is None:
 		menuprompt = "OS/161 kernel [? for menu]: "
 	if shellprompt is None:
@@ -149,6 +155,8 @@ def run(testcommands, outputfile,
 		args.append("-C")
 		args.append("31:ramsize=%s" % ram)
 	args.append(kernel)
+	if kernelargs is not None:
+		args.append(kernelargs)
 
 	proc = pexpect.spawn("sys161", args, timeout=timeout,
 				ignore_sighup=False)
@@ -421,27 +421,12 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
+	/* the child is created straight from the program, without copying the shell */
+	pid = spawnvp(args[0], args);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		exitinfo_exit(ei, 1);
+		return;
 	}
 
 	/* parent */
@@ -483,6 +468,10 @@ docommand(char *buf, struct exitinfo *ei)
  *
  * if there's an invalid character or a backspace when there's nothing
  * in the buffer, putchars an alert (bell).
+ *
+ * the console returns a whole line (or whatever has been typed so
+ * far) per read, so the input is taken a read at a time and the echo
+ * for all of it goes out with a single write.
  */
 static
 void
@@ -490,32 +479,46 @@ getcmd(char *buf, size_t len)
 {
 	size_t pos = 0;
 	int done=0, ch;
+	char in[256];
+	char echo[3*sizeof(in)];
+	ssize_t nin, i;
+	size_t necho;
 
 	/*
 	 * In the absence of a <ctype.h>, assume input is 7-bit ASCII.
 	 */
 
 	while (!done) {
-		ch = getchar();
-		if ((ch == '\b' || ch == 127) && pos > 0) {
-			putchar('\b');
-			putchar(' ');
-			putchar('\b');
-			pos--;
-		}
-		else if (ch == '\r' || ch == '\n') {
-			putchar('\r');
-			putchar('\n');
-			done = 1;
+		nin = read(STDIN_FILENO, in, sizeof(in));
+		if (nin <= 0) {
+			/* end of file or error: alert, as for any bad input */
+			write(STDOUT_FILENO, "\a", 1);
+			continue;
 		}
-		else if (ch >= 32 && ch < 127 && pos < len-1) {
-			buf[pos++] = ch;
-			putchar(ch);
-		}
-		else {
-			/* alert (bell) character */
-			putchar('\a');
+		necho = 0;
+		for (i=0; i<nin && !done; i++) {
+			ch = (unsigned char)in[i];
+			if ((ch == '\b' || ch == 127) && pos > 0) {
+				echo[necho++] = '\b';
+				echo[necho++] = ' ';
+				echo[necho++] = '\b';
+				pos--;
+			}
+			else if (ch == '\r' || ch == '\n') {
+				echo[necho++] = '\r';
+				echo[necho++] = '\n';
+				done = 1;
+			}
+			else if (ch >= 32 && ch < 127 && pos < len-1) {
+				buf[pos++] = ch;
+				echo[necho++] = ch;
+			}
+			else {
+				/* alert (bell) character */
+				echo[necho++] = '\a';
+			}
 		}
+		write(STDOUT_FILENO, echo, necho);
 	}
 	buf[pos] = 0;
 }
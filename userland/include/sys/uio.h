@@ -0,0 +1,14 @@
+#ifndef _SYS_UIO_H_
+#define _SYS_UIO_H_
+
+#include <sys/types.h>
+#include <kern/iovec.h>
+
+/*
+ * Scatter/gather I/O: read into or write from iovcnt buffers (at most
+ * IOV_MAX) with a single call. Returns the total number of bytes.
+ */
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+#endif /* _SYS_UIO_H_ */
@@ -0,0 +1,13 @@
+#ifndef _SYS_VMSTAT_H_
+#define _SYS_VMSTAT_H_
+
+#include <sys/types.h>
+#include <kern/vmstats.h>
+
+/*
+ * Copy up to ncounts VM counters (indexed by VMS_*) of process pid,
+ * or of the whole system if pid is 0. Returns the number copied.
+ */
+int vmstat(pid_t pid, unsigned int *counts, size_t ncounts);
+
+#endif /* _SYS_VMSTAT_H_ */
@@ -129,6 +129,7 @@ int rmdir(const char *dirname);
 
 /* Recommended. */
 pid_t getpid(void);
+pid_t getppid(void);
 int ioctl(int filehandle, int code, void *buf);
 off_t lseek(int filehandle, off_t pos, int code);
 int fsync(int filehandle);
@@ -147,7 +148,10 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
 ssize_t __getcwd(char *buf, size_t buflen);
+pid_t spawn(const char *prog, char *const *args);	/* fork + execv without copying the caller */
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -156,6 +160,7 @@ ssize_t __getcwd(char *buf, size_t buflen);
  */
 
 int execvp(const char *prog, char *const *args); /* calls execv */
+pid_t spawnvp(const char *prog, char *const *args); /* calls spawn */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
 
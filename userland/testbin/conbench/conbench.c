@@ -0,0 +1,81 @@
+/*
+ * conbench.c
+ *
+ * 	Writes the same amount of text to the console with write()
+ *	calls of different sizes, then prints how long each pass took.
+ *	The timings are printed at the end so they do not scroll away.
+ *	Usage: conbench [bytes]
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+/* write sizes: a character at a time, a line, a screenful */
+static const size_t sizes[] = { 1, 64, 2048 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+#define LINELEN 64
+#define MAXBYTES 65536
+
+static char buffer[MAXBYTES];
+static unsigned long elapsed[NSIZES];
+
+/* fill the buffer with lines of LINELEN characters */
+static void
+fill(size_t total)
+{
+	size_t i;
+
+	for (i = 0; i < total; i++) {
+		buffer[i] = (i % LINELEN == LINELEN - 1) ? '\n' : 'a' + i % 26;
+	}
+}
+
+/* write total bytes in writes of chunk bytes; returns the microseconds taken */
+static unsigned long
+pass(size_t total, size_t chunk)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	size_t i, len;
+	ssize_t r;
+
+	__time(&s0, &ns0);
+	for (i = 0; i < total; i += len) {
+		len = total - i < chunk ? total - i : chunk;
+		r = write(STDOUT_FILENO, buffer + i, len);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((size_t)r != len) {
+			errx(1, "short write: %d of %u", (int)r, (unsigned)len);
+		}
+	}
+	__time(&s1, &ns1);
+	return (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+	size_t total = 8192;
+	unsigned i;
+
+	if (argc > 1) {
+		total = atoi(argv[1]);
+	}
+	if (total == 0 || total > MAXBYTES) {
+		errx(1, "Usage: conbench [bytes], at most %u", MAXBYTES);
+	}
+	fill(total);
+	for (i = 0; i < NSIZES; i++) {
+		elapsed[i] = pass(total, sizes[i]);
+	}
+	for (i = 0; i < NSIZES; i++) {
+		printf("%5u bytes/write: %u bytes in %8lu us\n",
+		       (unsigned)sizes[i], (unsigned)total, elapsed[i]);
+	}
+	return 0;
+}
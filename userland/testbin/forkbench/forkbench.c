@@ -0,0 +1,94 @@
+/*
+ * forkbench.c
+ *
+ * 	Forks and reaps children in batches and prints the forks per
+ *	second of each batch; as the pids go around the table the rate
+ *	should stay the same. Also checks that a reaped child, or a
+ *	process that is not a child, cannot be waited for.
+ *	Usage: forkbench [batches [batchsize]]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <err.h>
+
+#define MAXBATCH 64
+
+static pid_t pids[MAXBATCH];
+
+/* fork and reap size children; returns the microseconds taken */
+static unsigned long
+batch(int size)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	int i, status;
+
+	__time(&s0, &ns0);
+	for (i = 0; i < size; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			_exit(0);
+		}
+	}
+	for (i = 0; i < size; i++) {
+		if (waitpid(pids[i], &status, 0) != pids[i]) {
+			err(1, "waitpid %d", (int)pids[i]);
+		}
+	}
+	__time(&s1, &ns1);
+	return (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+}
+
+/* waitpid on pid must fail with ECHILD */
+static void
+nochild(pid_t pid, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) >= 0) {
+		errx(1, "waitpid on %s (pid %d) succeeded", what, (int)pid);
+	}
+	if (errno != ECHILD) {
+		err(1, "waitpid on %s (pid %d): expected ECHILD", what, (int)pid);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int i, batches = 10, size = 16;
+	unsigned long us;
+
+	if (argc > 1) {
+		batches = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		size = atoi(argv[2]);
+	}
+	if (batches < 1 || size < 1 || size > MAXBATCH) {
+		errx(1, "Usage: forkbench [batches [batchsize (at most %d)]]",
+		     MAXBATCH);
+	}
+
+	for (i = 0; i < batches; i++) {
+		us = batch(size);
+		if (us == 0) {
+			us = 1;
+		}
+		printf("batch %3d: pids %4d-%4d, %6lu us, %5lu forks/s\n",
+		       i, (int)pids[0], (int)pids[size - 1], us,
+		       (unsigned long)size * 1000000 / us);
+	}
+	nochild(pids[0], "a reaped child");
+	nochild(getpid(), "itself");
+	printf("forkbench: passed\n");
+	return 0;
+}
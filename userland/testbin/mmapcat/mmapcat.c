@@ -0,0 +1,163 @@
+/*
+ * mmapcat.c
+ *
+ * 	Outputs a file by mapping it with mmap instead of reading it.
+ *	Usage: mmapcat <file>
+ *	       mmapcat -b <file>
+ *
+ * With -b the file is not printed: it is scanned once with read() and
+ * once through mmap(), and the time of both scans is reported together
+ * with a checksum of the data, which must be the same.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <sys/mman.h>
+
+#define BUFSIZE 4096
+
+/* Put buffer in data space: stack space is tight. */
+static char buffer[BUFSIZE];
+
+static
+unsigned
+checksum(const char *buf, size_t len, unsigned sum)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		sum = sum * 31 + (unsigned char)buf[i];
+	}
+	return sum;
+}
+
+static
+void
+now(time_t *secs, unsigned long *nsecs)
+{
+	if (__time(secs, nsecs) < 0) {
+		err(1, "__time");
+	}
+}
+
+static
+unsigned long
+elapsed_ms(time_t s0, unsigned long ns0, time_t s1, unsigned long ns1)
+{
+	return (s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+}
+
+/* scan the file with read(); returns its size */
+static
+size_t
+scan_read(const char *filename, unsigned *sum)
+{
+	int fd, len;
+	size_t size = 0;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	*sum = 0;
+	while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+		*sum = checksum(buffer, len, *sum);
+		size += len;
+	}
+	if (len < 0) {
+		err(1, "%s: read", filename);
+	}
+	close(fd);
+	return size;
+}
+
+/* map the first size bytes of the file */
+static
+char *
+map(const char *filename, size_t size)
+{
+	int fd;
+	char *p;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		err(1, "%s: mmap", filename);
+	}
+	/* the mapping keeps the file open */
+	close(fd);
+	return p;
+}
+
+static
+void
+bench(const char *filename)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned rsum, msum;
+	size_t size;
+	char *p;
+
+	now(&s0, &ns0);
+	size = scan_read(filename, &rsum);
+	now(&s1, &ns1);
+	printf("read: %lu bytes in %lu ms (checksum %x)\n",
+	       (unsigned long)size, elapsed_ms(s0, ns0, s1, ns1), rsum);
+	if (size == 0) {
+		errx(1, "%s: empty file", filename);
+	}
+
+	now(&s0, &ns0);
+	p = map(filename, size);
+	msum = checksum(p, size, 0);
+	if (munmap(p, size) < 0) {
+		err(1, "munmap");
+	}
+	now(&s1, &ns1);
+	printf("mmap: %lu bytes in %lu ms (checksum %x)\n",
+	       (unsigned long)size, elapsed_ms(s0, ns0, s1, ns1), msum);
+
+	if (rsum != msum) {
+		errx(1, "checksum mismatch");
+	}
+}
+
+static
+void
+cat(const char *filename)
+{
+	unsigned sum;
+	size_t size;
+	char *p;
+
+	/* there is no fstat: get the size with a first pass */
+	size = scan_read(filename, &sum);
+	if (size == 0) {
+		return;
+	}
+	p = map(filename, size);
+	write(STDOUT_FILENO, p, size);
+	munmap(p, size);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc == 3 && !strcmp(argv[1], "-b")) {
+		bench(argv[2]);
+	}
+	else if (argc == 2) {
+		cat(argv[1]);
+	}
+	else {
+		errx(1, "Usage: mmapcat [-b] <file>");
+	}
+	return 0;
+}
@@ -160,17 +160,20 @@ static int subargc = 0;
 
 static
 void
-spawn(int njobs)
+runjobs(int njobs)
 {
 	struct usem s1, s2;
 	pid_t pids[njobs];
 	int failed, status;
 	int i;
+	time_t t0, t1, t2;
+	unsigned long ns0, ns1, ns2, forkus, execus;
 
 	semcreate("1", &s1);
 	semcreate("2", &s2);
 
 	printf("Forking %d child processes...\n", njobs);
+	__time(&t0, &ns0);
 
 	for (i=0; i<njobs; i++) {
 		pids[i] = fork();
@@ -200,6 +203,7 @@ spawn(int njobs)
 	printf("Waiting for fork...\n");
 	semP(&s1, njobs);
 	printf("Starting the execs...\n");
+	__time(&t1, &ns1);
 	semV(&s2, njobs);
 
 	failed = 0;
@@ -219,6 +223,7 @@ spawn(int njobs)
 			failed++;
 		}
 	}
+	__time(&t2, &ns2);
 	if (failed > 0) {
 		warnx("%d children failed", failed);
 	}
@@ -226,6 +231,15 @@ spawn(int njobs)
 		printf("Succeeded\n");
 	}
 
+	/* fork: until all children are ready; exec: from the go to the last exit */
+	forkus = (t1 - t0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	execus = (t2 - t1) * 1000000 + ns2 / 1000 - ns1 / 1000;
+	if (njobs > 0) {
+		printf("fork: %lu us (%lu us each), exec+exit: %lu us "
+		       "(%lu us each)\n", forkus, forkus / njobs, execus,
+		       execus / njobs);
+	}
+
 	semclose(&s1);
 	semclose(&s2);
 	semdestroy(&s1);
@@ -266,7 +280,7 @@ main(int argc, char *argv[])
 	}
 	subargv[subargc] = NULL;
 
-	spawn(njobs);
+	runjobs(njobs);
 
 	return 0;
 }
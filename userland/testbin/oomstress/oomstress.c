@@ -0,0 +1,171 @@
+/*
+ * oomstress.c
+ *
+ * 	Runs the system out of processes and then out of memory and
+ *	swap space, and checks that it survives both.
+ *
+ *	First a bounded fork bomb: forks until fork fails, then reaps
+ *	every child. Then NHOGS children each write and check HOG_PAGES
+ *	pages, more than RAM and swapfile together, so that the OOM
+ *	killer has to step in; some of them die, the others (and this
+ *	process) must go on. Last, a single hog must run to completion
+ *	once the memory of the dead ones is back.
+ *	Usage: oomstress
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <err.h>
+
+#define PAGE_SIZE 4096
+
+/* fork bomb: never more children than this */
+#define MAXBOMBS 256
+/* memory hogs: NHOGS * HOG_PAGES pages do not fit in RAM and the 9 MB swapfile */
+#define NHOGS 6
+#define HOG_PAGES 640
+
+static pid_t pids[MAXBOMBS];
+
+/* child of the fork bomb: check that the address space is its own, then exit */
+static void
+bomb(void)
+{
+	static volatile pid_t mypid;
+	int i;
+
+	mypid = getpid();
+	for (i = 0; i < 100; i++) {
+		if (mypid != getpid()) {
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+/* memory hog: fill npages pages with a pattern and read it back */
+static void
+hog(int npages)
+{
+	unsigned *mem;
+	unsigned i, n, seed;
+
+	seed = (unsigned)getpid() * 2654435761U;
+	n = npages * (PAGE_SIZE / sizeof(unsigned));
+	mem = malloc(n * sizeof(unsigned));
+	if (mem == NULL) {
+		/* ENOMEM from sbrk is a clean failure too */
+		_exit(2);
+	}
+	for (i = 0; i < n; i += PAGE_SIZE / sizeof(unsigned) / 4) {
+		mem[i] = seed ^ i;
+	}
+	for (i = 0; i < n; i += PAGE_SIZE / sizeof(unsigned) / 4) {
+		if (mem[i] != (seed ^ i)) {
+			warnx("pid %d: page %u corrupted", getpid(),
+			      i / (PAGE_SIZE / sizeof(unsigned)));
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+/* wait for a child; returns its wait status (0 if it exited with 0) */
+static int
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid %d", pid);
+	}
+	return status;
+}
+
+static void
+forkbomb(void)
+{
+	int n, i, bad = 0;
+
+	for (n = 0; n < MAXBOMBS; n++) {
+		pids[n] = fork();
+		if (pids[n] < 0) {
+			break;
+		}
+		if (pids[n] == 0) {
+			bomb();
+		}
+	}
+	printf("oomstress: %d children before fork failed (%s)\n", n,
+	       n < MAXBOMBS ? strerror(errno) : "it did not");
+	for (i = 0; i < n; i++) {
+		if (reap(pids[i]) != 0) {
+			bad++;
+		}
+	}
+	if (bad > 0) {
+		errx(1, "%d children of the fork bomb failed", bad);
+	}
+}
+
+static void
+hogs(void)
+{
+	int i, status, ok = 0, killed = 0, nomem = 0;
+
+	for (i = 0; i < NHOGS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			hog(HOG_PAGES);
+		}
+	}
+	for (i = 0; i < NHOGS; i++) {
+		status = reap(pids[i]);
+		if (status == 0) {
+			ok++;
+		}
+		else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL) {
+			killed++;
+		}
+		else if (WIFEXITED(status) && WEXITSTATUS(status) == 2) {
+			nomem++;
+		}
+		else {
+			errx(1, "hog %d exited with status 0x%x", pids[i], status);
+		}
+	}
+	printf("oomstress: %d hogs done, %d killed, %d out of memory\n",
+	       ok, killed, nomem);
+}
+
+int
+main(void)
+{
+	pid_t pid;
+
+	forkbomb();
+	hogs();
+
+	/* the memory of the dead hogs must be available again */
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		hog(HOG_PAGES);
+	}
+	if (reap(pid) != 0) {
+		errx(1, "a hog failed after the OOM killer ran");
+	}
+	printf("oomstress: passed\n");
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * openbench.c
+ *
+ * 	Several processes open and close the same file over and over,
+ *	two descriptors at a time, first one process alone and then
+ *	nprocs together. Checks that each open gets the lowest free
+ *	descriptor and an offset of its own, and prints the time and
+ *	the opens per second of both runs.
+ *	Usage: openbench <filename> [nprocs [iterations]]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+#define MAXPROCS 16
+
+/* child: open and close filename iters times; exits 1 on any failure */
+static void
+opener(const char *filename, int iters)
+{
+	int i, a, b, first = -1;
+
+	for (i = 0; i < iters; i++) {
+		a = open(filename, O_RDONLY);
+		b = open(filename, O_RDONLY);
+		if (a < 0 || b < 0) {
+			warn("%s", filename);
+			_exit(1);
+		}
+		/* closed descriptors are reused lowest first */
+		if (first < 0) {
+			first = a;
+		}
+		if (a != first || b != first + 1) {
+			warnx("got fds %d and %d, expected %d and %d",
+			      a, b, first, first + 1);
+			_exit(1);
+		}
+		/* separate opens do not share the offset */
+		if (lseek(a, 1, SEEK_SET) != 1 || lseek(b, 0, SEEK_CUR) != 0) {
+			warnx("the two opens share the offset");
+			_exit(1);
+		}
+		close(b);
+		close(a);
+	}
+	_exit(0);
+}
+
+/* run nprocs children doing opener and print the time they took */
+static void
+run(const char *filename, int nprocs, int iters)
+{
+	pid_t pids[MAXPROCS];
+	time_t s0, s1;
+	unsigned long ns0, ns1, us;
+	int i, status, failed = 0;
+
+	__time(&s0, &ns0);
+	for (i = 0; i < nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			opener(filename, iters);
+		}
+	}
+	for (i = 0; i < nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (status != 0) {
+			failed++;
+		}
+	}
+	__time(&s1, &ns1);
+	if (failed > 0) {
+		errx(1, "%d openers failed", failed);
+	}
+
+	us = (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	printf("%2d procs: %7d opens in %9lu us, %7lu opens/s\n", nprocs,
+	       2 * nprocs * iters, us,
+	       (unsigned long)((unsigned long long)2 * nprocs * iters * 1000000 / us));
+}
+
+int
+main(int argc, char *argv[])
+{
+	int nprocs = 4, iters = 1000;
+
+	if (argc < 2 || argc > 4) {
+		errx(1, "Usage: openbench <filename> [nprocs [iterations]]");
+	}
+	if (argc >= 3) {
+		nprocs = atoi(argv[2]);
+	}
+	if (argc == 4) {
+		iters = atoi(argv[3]);
+	}
+	if (nprocs < 1 || nprocs > MAXPROCS) {
+		errx(1, "nprocs must be between 1 and %d", MAXPROCS);
+	}
+	if (iters < 1) {
+		errx(1, "iterations must be at least 1");
+	}
+
+	run(argv[1], 1, iters);
+	run(argv[1], nprocs, iters);
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * preadbench.c
+ *
+ * 	Several processes read the same open file (shared through
+ *	fork) together, first with read() on the shared offset, which
+ *	the kernel moves one call at a time, then with pread() at
+ *	offsets of their own, which do not wait for each other. Prints
+ *	the time and throughput of both. Make the file first, e.g. with
+ *	"bigfile lhd0:big 1048576/8192".
+ *	Usage: preadbench <filename> [nprocs]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+#define BLOCK 4096
+#define MAXPROCS 16
+
+static char buffer[BLOCK];
+
+/* child: read the shared offset until the end of the file */
+static void
+reader(int fd)
+{
+	ssize_t len;
+
+	while ((len = read(fd, buffer, BLOCK)) > 0) {
+		/* nothing */
+	}
+	_exit(len < 0 ? 1 : 0);
+}
+
+/* child: pread blocks me, me + nprocs, me + 2 * nprocs... */
+static void
+preader(int fd, int me, int nprocs, off_t size)
+{
+	off_t pos;
+
+	for (pos = (off_t)me * BLOCK; pos < size; pos += (off_t)nprocs * BLOCK) {
+		if (pread(fd, buffer, BLOCK, pos) < 0) {
+			_exit(1);
+		}
+	}
+	_exit(0);
+}
+
+/* run nprocs children doing reader or preader and print the time they took */
+static void
+run(const char *what, int fd, int nprocs, off_t size, int usepread)
+{
+	pid_t pids[MAXPROCS];
+	time_t s0, s1;
+	unsigned long ns0, ns1, us;
+	int i, status, failed = 0;
+
+	__time(&s0, &ns0);
+	for (i = 0; i < nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			if (usepread) {
+				preader(fd, i, nprocs, size);
+			}
+			reader(fd);
+		}
+	}
+	for (i = 0; i < nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (status != 0) {
+			failed++;
+		}
+	}
+	__time(&s1, &ns1);
+	if (failed > 0) {
+		errx(1, "%s: %d readers failed", what, failed);
+	}
+
+	us = (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	printf("%-6s %2d procs: %9lu us, %6lu KB/s\n", what, nprocs, us,
+	       (unsigned long)((unsigned long long)size * 1000000 / 1024 / us));
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd, nprocs = 4;
+	off_t size, pos;
+
+	if (argc < 2 || argc > 3) {
+		errx(1, "Usage: preadbench <filename> [nprocs]");
+	}
+	if (argc == 3) {
+		nprocs = atoi(argv[2]);
+	}
+	if (nprocs < 1 || nprocs > MAXPROCS) {
+		errx(1, "nprocs must be between 1 and %d", MAXPROCS);
+	}
+
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", argv[1]);
+	}
+	size = lseek(fd, 0, SEEK_END);
+	if (size < 0) {
+		err(1, "%s: lseek", argv[1]);
+	}
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "%s: lseek", argv[1]);
+	}
+
+	run("read", fd, nprocs, size, 0);
+	/* every byte was read exactly once through the shared offset */
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != size) {
+		errx(1, "offset is %lld after reading %lld bytes",
+		     (long long)pos, (long long)size);
+	}
+	run("pread", fd, nprocs, size, 1);
+	/* pread does not move the offset */
+	if (lseek(fd, 0, SEEK_CUR) != size) {
+		errx(1, "pread moved the offset");
+	}
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * readbench.c
+ *
+ * 	Reads a whole file with read() calls of increasing size and
+ *	prints the throughput of each pass. Make the file first, e.g.
+ *	with "bigfile lhd0:big 1048576/8192".
+ *	Usage: readbench <filename> [bufsize...]
+ */
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+/* default buffer sizes: from a console line to a 1 MB read */
+static const size_t sizes[] = { 512, 4096, 65536, 1048576 };
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/* the largest buffer, static so that it does not depend on malloc */
+static char buffer[1048576];
+
+/* read the whole file in bufsize reads; returns the bytes read */
+static size_t
+pass(const char *filename, size_t bufsize)
+{
+	size_t total = 0;
+	ssize_t len;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	while ((len = read(fd, buffer, bufsize)) > 0) {
+		total += len;
+	}
+	if (len < 0) {
+		err(1, "%s: read", filename);
+	}
+	close(fd);
+	return total;
+}
+
+static void
+bench(const char *filename, size_t bufsize)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1, us;
+	size_t total;
+
+	if (bufsize == 0 || bufsize > sizeof(buffer)) {
+		errx(1, "buffer size must be between 1 and %u",
+		     (unsigned)sizeof(buffer));
+	}
+	__time(&s0, &ns0);
+	total = pass(filename, bufsize);
+	__time(&s1, &ns1);
+
+	us = (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	if (us == 0) {
+		us = 1;
+	}
+	printf("%8u bytes/read: %9u bytes in %8lu us, %6lu KB/s\n",
+	       (unsigned)bufsize, (unsigned)total, us,
+	       (unsigned long)((unsigned long long)total * 1000000 / 1024 / us));
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned i;
+	int j;
+
+	if (argc < 2) {
+		errx(1, "Usage: readbench <filename> [bufsize...]");
+	}
+	if (argc == 2) {
+		for (i = 0; i < NSIZES; i++) {
+			bench(argv[1], sizes[i]);
+		}
+	}
+	for (j = 2; j < argc; j++) {
+		bench(argv[1], atoi(argv[j]));
+	}
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * spawnbench.c
+ *
+ * 	Starts copies of itself (which just exit) first with fork and
+ *	execv, then with spawn, and prints the processes per second of
+ *	each; spawn should be faster as it never copies the parent, all
+ *	the more so the larger the parent is (the -k option makes it
+ *	touch that many KB of heap first). Also checks that the child
+ *	gets the arguments and the descriptors of the parent, and that
+ *	spawning a missing program fails with ENOENT.
+ *	Usage: spawnbench [-k kbytes] [count]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <err.h>
+
+#define PROG "/testbin/spawnbench"
+#define CHILDARG "-child"
+#define CHILDEXIT 7
+
+static char *cargv[] = { (char *)PROG, (char *)CHILDARG, NULL };
+
+/* child: write a byte to the descriptor given as argument, if any */
+static int
+child(int argc, char *argv[])
+{
+	if (argc > 2 && write(atoi(argv[2]), "x", 1) != 1) {
+		return 1;
+	}
+	return CHILDEXIT;
+}
+
+/* wait for pid, which must exit with CHILDEXIT */
+static void
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid %d", (int)pid);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != CHILDEXIT) {
+		errx(1, "pid %d: bad exit status 0x%x", (int)pid, status);
+	}
+}
+
+static pid_t
+forkexec(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(PROG, cargv);
+		err(1, "%s", PROG);
+	}
+	return pid;
+}
+
+static pid_t
+dospawn(void)
+{
+	pid_t pid;
+
+	pid = spawn(PROG, cargv);
+	if (pid < 0) {
+		err(1, "spawn %s", PROG);
+	}
+	return pid;
+}
+
+/* start and reap count children with start; returns the microseconds taken */
+static unsigned long
+run(pid_t (*start)(void), int count)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	int i;
+
+	__time(&s0, &ns0);
+	for (i = 0; i < count; i++) {
+		reap(start());
+	}
+	__time(&s1, &ns1);
+	return (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+}
+
+static void
+report(const char *what, int count, unsigned long us)
+{
+	if (us == 0) {
+		us = 1;
+	}
+	printf("%-10s %4d children, %8lu us, %5lu processes/s\n",
+	       what, count, us, (unsigned long)count * 1000000 / us);
+}
+
+/* the child must write to the descriptor it inherited */
+static void
+inherit(void)
+{
+	char fdarg[16], buf[4];
+	char *argv[] = { (char *)PROG, (char *)CHILDARG, fdarg, NULL };
+	int fd;
+
+	fd = open("spawnbench.tmp", O_RDWR | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "spawnbench.tmp");
+	}
+	snprintf(fdarg, sizeof(fdarg), "%d", fd);
+	reap(spawn(PROG, argv));
+	if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, buf, sizeof(buf)) != 1 ||
+	    buf[0] != 'x') {
+		errx(1, "the child did not write to the inherited descriptor");
+	}
+	close(fd);
+	remove("spawnbench.tmp");
+}
+
+/* a missing program is reported by spawn itself */
+static void
+missing(void)
+{
+	if (spawn("/testbin/nonexistent", cargv) >= 0) {
+		errx(1, "spawn of a missing program succeeded");
+	}
+	if (errno != ENOENT) {
+		err(1, "spawn of a missing program: expected ENOENT");
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	int count = 32, kbytes = 0, i = 1;
+	char *heap;
+
+	if (argc > 1 && !strcmp(argv[1], CHILDARG)) {
+		return child(argc, argv);
+	}
+	if (argc > 2 && !strcmp(argv[1], "-k")) {
+		kbytes = atoi(argv[2]);
+		i = 3;
+	}
+	if (argc > i) {
+		count = atoi(argv[i]);
+	}
+	if (count < 1 || kbytes < 0) {
+		errx(1, "Usage: spawnbench [-k kbytes] [count]");
+	}
+	if (kbytes > 0) {
+		heap = malloc((size_t)kbytes * 1024);
+		if (heap == NULL) {
+			err(1, "malloc");
+		}
+		memset(heap, 1, (size_t)kbytes * 1024);
+	}
+
+	report("fork+exec", count, run(forkexec, count));
+	report("spawn", count, run(dospawn, count));
+	inherit();
+	missing();
+	printf("spawnbench: passed\n");
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * tlbthrash.c
+ *
+ * 	Touches more pages than the TLB can hold, over and over, so that
+ *	almost every access is a TLB miss on a page that is already in
+ *	memory. Reports the average cost of an access.
+ *	Usage: tlbthrash [pages] [rounds]
+ *
+ * The default of 128 pages is twice the size of the TLB and small
+ * enough to stay resident. Compare the reported time (and the TLB
+ * counters printed by the kernel at shutdown) with and without the
+ * fast-path TLB refill.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+#define PAGE_SIZE 4096
+#define MAXPAGES 512
+
+#define DEFAULT_PAGES 128
+#define DEFAULT_ROUNDS 200
+
+/* in BSS: pages are faulted in on the first round */
+static char area[MAXPAGES * PAGE_SIZE];
+
+int
+main(int argc, char **argv)
+{
+	unsigned pages = DEFAULT_PAGES, rounds = DEFAULT_ROUNDS;
+	unsigned i, r, sum = 0;
+	time_t s0, s1;
+	unsigned long ns0, ns1, us;
+
+	if (argc > 1) {
+		pages = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		rounds = atoi(argv[2]);
+	}
+	if (pages == 0 || pages > MAXPAGES || rounds == 0) {
+		errx(1, "Usage: tlbthrash [pages (1-%d)] [rounds]", MAXPAGES);
+	}
+
+	/* first round: page faults, not measured */
+	for (i=0; i<pages; i++) {
+		area[i * PAGE_SIZE] = i;
+	}
+
+	__time(&s0, &ns0);
+	for (r=0; r<rounds; r++) {
+		/* one access per page: every page is evicted from the TLB before it is used again */
+		for (i=0; i<pages; i++) {
+			sum += area[i * PAGE_SIZE];
+		}
+	}
+	__time(&s1, &ns1);
+
+	us = (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	printf("tlbthrash: %u pages x %u rounds: %lu us, %u ns per access (sum %u)\n",
+	       pages, rounds, us,
+	       (unsigned)((us * 1000ULL) / ((unsigned long long)pages * rounds)), sum);
+	return 0;
+}
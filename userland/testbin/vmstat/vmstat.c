@@ -0,0 +1,94 @@
+/*
+ * vmstat.c
+ *
+ * 	Prints the VM counters of the whole system and of every process
+ *	(or only of the processes given on the command line), one line
+ *	each, so that a process that keeps faulting or swapping stands
+ *	out while the others are still running.
+ *	Usage: vmstat [pid...]
+ */
+
+#include <sys/vmstat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <errno.h>
+#include <err.h>
+
+/* the columns printed, a subset of the VMS_* counters */
+static const struct {
+	int code;
+	const char *name;
+} columns[] = {
+	{ VMS_FAULTS,          "faults" },
+	{ VMS_RELOAD,          "reload" },
+	{ VMS_FAULTS_ZEROED,   "zeroed" },
+	{ VMS_FAULTS_ELF,      "elf" },
+	{ VMS_FAULTS_MMAP,     "mmap" },
+	{ VMS_FAULTS_SWAPFILE, "swapin" },
+	{ VMS_SWAPFILE_WRITES, "swapout" },
+	{ VMS_EVICTIONS,       "evict" },
+};
+#define NCOLUMNS (sizeof(columns) / sizeof(columns[0]))
+
+static void
+header(void)
+{
+	unsigned i;
+
+	printf("%6s", "pid");
+	for (i = 0; i < NCOLUMNS; i++) {
+		printf(" %8s", columns[i].name);
+	}
+	printf("\n");
+}
+
+/* returns -1 (with errno set) if there is no such process */
+static int
+row(pid_t pid)
+{
+	unsigned int counts[VMS_NSTATS];
+	unsigned i;
+
+	if (vmstat(pid, counts, VMS_NSTATS) < 0) {
+		return -1;
+	}
+	if (pid == 0) {
+		printf("%6s", "all");
+	}
+	else {
+		printf("%6d", pid);
+	}
+	for (i = 0; i < NCOLUMNS; i++) {
+		printf(" %8u", counts[columns[i].code]);
+	}
+	printf("\n");
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	pid_t pid;
+	int i;
+
+	header();
+	if (row(0) < 0) {
+		err(1, "vmstat");
+	}
+	if (argc > 1) {
+		for (i = 1; i < argc; i++) {
+			if (row(atoi(argv[i])) < 0) {
+				warn("%s", argv[i]);
+			}
+		}
+		return 0;
+	}
+	for (pid = PID_MIN; pid < PID_MAX; pid++) {
+		if (row(pid) < 0 && errno != ESRCH) {
+			err(1, "vmstat %d", pid);
+		}
+	}
+	return 0;
+}
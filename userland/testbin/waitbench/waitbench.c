@@ -0,0 +1,187 @@
+/*
+ * waitbench.c
+ *
+ * 	Checks waitpid: exit statuses (exit code and fatal signal),
+ *	WNOHANG on a running child, ECHILD for processes that are not
+ *	children of the caller (itself, a reaped child, a grandchild),
+ *	EINVAL for bad options, and getppid in an orphan. Then times
+ *	fork+exit+waitpid.
+ *	Usage: waitbench [iterations]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <err.h>
+
+/* spin for about us microseconds */
+static void
+spin(unsigned long us)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+
+	__time(&s0, &ns0);
+	do {
+		__time(&s1, &ns1);
+	} while ((s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000 < us);
+}
+
+static pid_t
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	return pid;
+}
+
+/* waitpid on pid must fail with error e */
+static void
+waitfail(pid_t pid, int options, int e, const char *what)
+{
+	int status;
+
+	if (waitpid(pid, &status, options) >= 0) {
+		errx(1, "waitpid on %s succeeded", what);
+	}
+	if (errno != e) {
+		err(1, "waitpid on %s: wrong error", what);
+	}
+}
+
+/* reap pid, which must succeed; returns its status */
+static int
+reap(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid %d", (int)pid);
+	}
+	return status;
+}
+
+static void
+test_status(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = dofork();
+	if (pid == 0) {
+		_exit(42);
+	}
+	status = reap(pid);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 42) {
+		errx(1, "exit 42 gave status 0x%x", status);
+	}
+	waitfail(pid, 0, ECHILD, "a reaped child");
+
+	pid = dofork();
+	if (pid == 0) {
+		volatile int *p = NULL;
+		*p = 0;
+		_exit(0);
+	}
+	status = reap(pid);
+	if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSEGV) {
+		errx(1, "a NULL dereference gave status 0x%x", status);
+	}
+	printf("exit statuses: ok\n");
+}
+
+static void
+test_wnohang(void)
+{
+	pid_t pid;
+	int status;
+
+	pid = dofork();
+	if (pid == 0) {
+		spin(500000);
+		_exit(7);
+	}
+	if (waitpid(pid, &status, WNOHANG) != 0) {
+		errx(1, "WNOHANG on a running child did not return 0");
+	}
+	waitfail(pid, 12345, EINVAL, "bad options");
+	status = reap(pid);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 7) {
+		errx(1, "exit 7 gave status 0x%x", status);
+	}
+	printf("WNOHANG: ok\n");
+}
+
+static void
+test_echild(void)
+{
+	pid_t pid, gc;
+	int status;
+
+	waitfail(getpid(), 0, ECHILD, "itself");
+
+	/* the child reports its own child, which we must not be able to wait for */
+	pid = dofork();
+	if (pid == 0) {
+		gc = dofork();
+		if (gc == 0) {
+			/* outlive the parent, then be an orphan */
+			spin(300000);
+			_exit(getppid() == 0 ? 0 : 1);
+		}
+		_exit(gc);
+	}
+	status = reap(pid);
+	gc = WEXITSTATUS(status);
+	waitfail(gc, 0, ECHILD, "a grandchild");
+	printf("ECHILD: ok\n");
+}
+
+static void
+bench(int iters)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1, us;
+	pid_t pid;
+	int i;
+
+	__time(&s0, &ns0);
+	for (i = 0; i < iters; i++) {
+		pid = dofork();
+		if (pid == 0) {
+			_exit(0);
+		}
+		reap(pid);
+	}
+	__time(&s1, &ns1);
+	us = (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	printf("%d fork+exit+waitpid: %lu us, %lu us each\n", iters, us,
+	       us / iters);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int iters = 200;
+
+	if (argc > 1) {
+		iters = atoi(argv[1]);
+	}
+	if (iters < 1) {
+		errx(1, "Usage: waitbench [iterations]");
+	}
+	test_status();
+	test_wnohang();
+	test_echild();
+	bench(iters);
+	printf("waitbench: passed\n");
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * writevbench.c
+ *
+ * 	Writes NRECORDS records, each a small header followed by a
+ *	payload, first with two write() calls per record and then with
+ *	one writev() per record, and prints the time of both. Then reads
+ *	the second file back with readv() and checks every record.
+ *	Usage: writevbench [filename]
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+
+#define NRECORDS 2000
+#define PAYLOAD 112
+
+struct header {
+	unsigned h_seq;
+	unsigned h_len;
+	unsigned h_sum;
+	unsigned h_magic;
+};
+#define MAGIC 0x5ca77e42
+
+static char payload[PAYLOAD];
+
+/* fill the header and payload of record seq */
+static void
+mkrecord(unsigned seq, struct header *h)
+{
+	unsigned i;
+
+	h->h_seq = seq;
+	h->h_len = PAYLOAD;
+	h->h_sum = 0;
+	h->h_magic = MAGIC;
+	for (i = 0; i < PAYLOAD; i++) {
+		payload[i] = (char)(seq + i);
+		h->h_sum += (unsigned char)payload[i];
+	}
+}
+
+static unsigned long
+elapsed_us(time_t s0, unsigned long ns0)
+{
+	time_t s1;
+	unsigned long ns1, us;
+
+	__time(&s1, &ns1);
+	us = (s1 - s0) * 1000000 + ns1 / 1000 - ns0 / 1000;
+	return us == 0 ? 1 : us;
+}
+
+/* write all the records to filename, with writev if usev is set; returns the time taken */
+static unsigned long
+writeall(const char *filename, int usev)
+{
+	struct header h;
+	struct iovec iov[2];
+	time_t s0;
+	unsigned long ns0;
+	unsigned seq;
+	ssize_t len;
+	int fd;
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	__time(&s0, &ns0);
+	for (seq = 0; seq < NRECORDS; seq++) {
+		mkrecord(seq, &h);
+		if (usev) {
+			iov[0].iov_base = &h;
+			iov[0].iov_len = sizeof(h);
+			iov[1].iov_base = payload;
+			iov[1].iov_len = PAYLOAD;
+			len = writev(fd, iov, 2);
+		}
+		else {
+			len = write(fd, &h, sizeof(h));
+			if (len == sizeof(h)) {
+				len += write(fd, payload, PAYLOAD);
+			}
+		}
+		if (len != sizeof(h) + PAYLOAD) {
+			err(1, "%s: record %u", filename, seq);
+		}
+	}
+	close(fd);
+	return elapsed_us(s0, ns0);
+}
+
+/* read filename back with readv, checking every record */
+static void
+check(const char *filename)
+{
+	struct header h;
+	struct iovec iov[2];
+	unsigned seq, i, sum;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", filename);
+	}
+	iov[0].iov_base = &h;
+	iov[0].iov_len = sizeof(h);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = PAYLOAD;
+	for (seq = 0; seq < NRECORDS; seq++) {
+		if (readv(fd, iov, 2) != sizeof(h) + PAYLOAD) {
+			err(1, "%s: short read at record %u", filename, seq);
+		}
+		for (i = 0, sum = 0; i < PAYLOAD; i++) {
+			sum += (unsigned char)payload[i];
+		}
+		if (h.h_magic != MAGIC || h.h_seq != seq || h.h_len != PAYLOAD ||
+		    h.h_sum != sum) {
+			errx(1, "%s: record %u is corrupted", filename, seq);
+		}
+	}
+	if (readv(fd, iov, 2) != 0) {
+		errx(1, "%s: data past the last record", filename);
+	}
+	close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *filename = "writevbench.dat";
+	unsigned long us;
+
+	if (argc > 2) {
+		errx(1, "Usage: writevbench [filename]");
+	}
+	if (argc == 2) {
+		filename = argv[1];
+	}
+
+	us = writeall(filename, 0);
+	printf("write:  %d records in %8lu us (%lu us/record)\n",
+	       NRECORDS, us, us / NRECORDS);
+	us = writeall(filename, 1);
+	printf("writev: %d records in %8lu us (%lu us/record)\n",
+	       NRECORDS, us, us / NRECORDS);
+	check(filename);
+	printf("writevbench: readv check passed\n");
+	return 0;
+}